@@ -23520,6 +23520,16 @@ var Decoder = /** @class */ (function () {
     Decoder.prototype.changeVideoMode = function (videoMode) {
         $("#current-video-mode").text(ivideo_mode_1.getVideoModeText(videoMode));
     };
+    // Should be called after the frame has been displayed
+    Decoder.prototype.reportLatencies = function (header) {
+        if (this.onLatencies) {
+            this.onLatencies({
+                client: Date.now() - header.pushTimestamp,
+                server: header.encodeEndTimestamp - header.pushTimestamp,
+                frameIndex: header.frameIndex
+            });
+        }
+    };
     Decoder.prototype.changeOptions = function (options) {
         this._options = options;
         if (this.onOptionsChanged) {
@@ -23736,6 +23746,77 @@ function deserializeEvent(buffer) {
 exports.deserializeEvent = deserializeEvent;
 
 
+/***/ }),
+
+/***/ "./src/frame-header.ts":
+/*!*****************************!*\
+  !*** ./src/frame-header.ts ***!
+  \*****************************/
+/*! no static exports found */
+/***/ (function(module, exports, __webpack_require__) {
+
+"use strict";
+
+// Mirrors webstreamer::EncodedFrameHeader (encoded_frame_header.hpp) which
+// precedes the data of every encoded frame.
+Object.defineProperty(exports, "__esModule", { value: true });
+exports.FRAME_HEADER_SIZE = 40;
+// FrameHeader flags
+var LAST_PART = 1;
+function getTimestamp(dataView, offset) {
+    // The server sends microseconds as 64 bit integers
+    var low = dataView.getUint32(offset, true);
+    var high = dataView.getUint32(offset + 4, true);
+    return (high * 4294967296 + low) / 1000;
+}
+function parseFrameHeader(data) {
+    var dataView = new DataView(data.buffer, data.byteOffset, exports.FRAME_HEADER_SIZE);
+    return {
+        frameIndex: dataView.getUint32(0, true),
+        width: dataView.getUint16(4, true),
+        height: dataView.getUint16(6, true),
+        pushTimestamp: getTimestamp(dataView, 8),
+        encodeStartTimestamp: getTimestamp(dataView, 16),
+        encodeEndTimestamp: getTimestamp(dataView, 24),
+        partIndex: dataView.getUint16(32, true),
+        isLastPart: (dataView.getUint16(34, true) & LAST_PART) !== 0,
+    };
+}
+exports.parseFrameHeader = parseFrameHeader;
+
+
+/***/ }),
+
+/***/ "./src/getQueryVariable.ts":
+/*!*********************************!*\
+  !*** ./src/getQueryVariable.ts ***!
+  \*********************************/
+/*! no static exports found */
+/***/ (function(module, exports, __webpack_require__) {
+
+"use strict";
+
+Object.defineProperty(exports, "__esModule", { value: true });
+var $_GET = {};
+if (document.location.toString().indexOf("?") !== -1) {
+    var query = document.location
+        .toString()
+        // get the query string
+        .replace(/^.*?\?/, "")
+        // and remove any existing hash string (thanks, @vrijdenker)
+        .replace(/#.*$/, "")
+        .split("&");
+    for (var i = 0, l = query.length; i < l; i++) {
+        var aux = decodeURIComponent(query[i]).split("=");
+        $_GET[aux[0]] = aux[1];
+    }
+}
+function getQueryVariable(name) {
+    return $_GET[name];
+}
+exports.getQueryVariable = getQueryVariable;
+
+
 /***/ }),
 
 /***/ "./src/h264-decoder.ts":
@@ -23775,8 +23856,9 @@ var H264Decoder = /** @class */ (function (_super) {
         _this.domElement = _this.avc.canvas;
         return _this;
     }
-    H264Decoder.prototype.decodeFrame = function (frameData) {
-        this.avc.decode(new Uint8Array(frameData.buffer, frameData.byteOffset));
+    H264Decoder.prototype.decodeFrame = function (frameData, header) {
+        this.avc.decode(new Uint8Array(frameData.buffer, frameData.byteOffset, frameData.byteLength));
+        this.reportLatencies(header);
     };
     H264Decoder.prototype.changeVideoMode = function (videoMode) {
         _super.prototype.changeVideoMode.call(this, videoMode);
@@ -24309,7 +24391,7 @@ var RawDecoder = /** @class */ (function (_super) {
     RawDecoder.prototype.configure = function (configuration) {
         throw new Error("Method not implemented.");
     };
-    RawDecoder.prototype.decodeFrame = function (frameData) {
+    RawDecoder.prototype.decodeFrame = function (frameData, header) {
         if (!this.buffer || this.buffer.width * this.buffer.height * 3 !== frameData.byteLength) {
             console.info("Invalid byte length of encoded frame.");
             return;
@@ -24326,6 +24408,7 @@ var RawDecoder = /** @class */ (function (_super) {
             }
         }
         this.context.putImageData(this.buffer, 0, 0);
+        this.reportLatencies(header);
     };
     RawDecoder.prototype.changeVideoMode = function (videoMode) {
         _super.prototype.changeVideoMode.call(this, videoMode);
@@ -24996,6 +25079,7 @@ Object.defineProperty(exports, "__esModule", { value: true });
 var $ = __webpack_require__(/*! jquery */ "./node_modules/jquery/dist/jquery.js");
 var stream_1 = __webpack_require__(/*! ./stream */ "./src/stream.ts");
 var decoder_1 = __webpack_require__(/*! ./decoder */ "./src/decoder.ts");
+var frame_header_1 = __webpack_require__(/*! ./frame-header */ "./src/frame-header.ts");
 var events_1 = __webpack_require__(/*! ./events */ "./src/events.ts");
 var h264_decoder_1 = __webpack_require__(/*! ./h264-decoder */ "./src/h264-decoder.ts");
 var websocket_stream_1 = __webpack_require__(/*! ./websocket-stream */ "./src/websocket-stream.ts");
@@ -25007,12 +25091,14 @@ var advanced_settings_overlay_1 = __webpack_require__(/*! ./advanced-settings-ov
 var webrtc_stream_1 = __webpack_require__(/*! ./webrtc-stream */ "./src/webrtc-stream.ts");
 var input_capturer_1 = __webpack_require__(/*! ./input-capturer */ "./src/input-capturer.ts");
 var clipboard_1 = __webpack_require__(/*! ./clipboard */ "./src/clipboard.ts");
+var getQueryVariable_1 = __webpack_require__(/*! ./getQueryVariable */ "./src/getQueryVariable.ts");
 var WebStreamer = /** @class */ (function () {
     function WebStreamer() {
         var _this = this;
         this.isStopped = false;
         this.currentVideoMode = null;
         this.inputCapturer = new input_capturer_1.InputCapturer();
+        this.frameParts = [];
         ajax_1.AJAXGetTextRequest("stream_config.json", function (response) {
             _this.streamConfig = JSON.parse(response);
             _this.selectStreamAndCodec();
@@ -25083,7 +25169,7 @@ var WebStreamer = /** @class */ (function () {
                     _this.stream.sendEvent({
                         type: events_1.EventType.ChangeCodec,
                         codec: _this.decoder.codec,
-                        options: _this.decoder.options
+                        options: _this.getCodecOptions()
                     });
                 }
             };
@@ -25118,12 +25204,17 @@ var WebStreamer = /** @class */ (function () {
         }
         if (this.decoder) {
             this.decoder.onAvailableVideoModesChange = function () { return _this.chooseVideoMode(); };
+            this.decoder.onLatencies = function (latencies) {
+                if (_this.onLatencies) {
+                    _this.onLatencies(latencies);
+                }
+            };
             this.decoder.onOptionsChanged = function () {
                 if (_this.stream && _this.stream.isConnected) {
                     _this.stream.sendEvent({
                         type: events_1.EventType.ChangeCodec,
                         codec: _this.decoder.codec,
-                        options: _this.decoder.options
+                        options: _this.getCodecOptions()
                     });
                 }
             };
@@ -25161,9 +25252,66 @@ var WebStreamer = /** @class */ (function () {
         }
         //this.selectStream(StreamType.WebRTC);
     };
+    // The server streams the frames of the source given in the URL, e.g.,
+    // "?source=name", or the frames of its default source otherwise.
+    WebStreamer.prototype.getCodecOptions = function () {
+        var options = {};
+        for (var key in this.decoder.options) {
+            options[key] = this.decoder.options[key];
+        }
+        var source = getQueryVariable_1.getQueryVariable("source");
+        if (source) {
+            options["source"] = source;
+        }
+        return options;
+    };
     WebStreamer.prototype.onVideoData = function (encodedFrame) {
+        if (encodedFrame.byteLength < frame_header_1.FRAME_HEADER_SIZE) {
+            console.warn("Received frame without header");
+            return;
+        }
         if (!this.isStopped && this.decoder) {
-            this.decoder.decodeFrame(encodedFrame);
+            var header = frame_header_1.parseFrameHeader(encodedFrame);
+            var frameData = new Uint8Array(encodedFrame.buffer, encodedFrame.byteOffset + frame_header_1.FRAME_HEADER_SIZE, encodedFrame.byteLength - frame_header_1.FRAME_HEADER_SIZE);
+            if (header.partIndex === 0 && header.isLastPart) {
+                this.decoder.decodeFrame(frameData, header);
+            }
+            else {
+                this.onVideoDataPart(frameData, header);
+            }
+        }
+    };
+    // Collects the parts of a frame and decodes the frame once its last part
+    // has arrived. Frames with missing parts are skipped.
+    WebStreamer.prototype.onVideoDataPart = function (frameData, header) {
+        if (header.partIndex === 0) {
+            this.frameParts = [];
+            this.framePartsFrameIndex = header.frameIndex;
+        }
+        else if (header.frameIndex !== this.framePartsFrameIndex ||
+            header.partIndex !== this.frameParts.length) {
+            console.warn("Received incomplete frame");
+            this.frameParts = [];
+            this.framePartsFrameIndex = undefined;
+            return;
+        }
+        this.frameParts.push(frameData);
+        if (header.isLastPart) {
+            var size = 0;
+            for (var _i = 0, _a = this.frameParts; _i < _a.length; _i++) {
+                var part = _a[_i];
+                size += part.byteLength;
+            }
+            var frame = new Uint8Array(size);
+            var offset = 0;
+            for (var _b = 0, _c = this.frameParts; _b < _c.length; _b++) {
+                var part = _c[_b];
+                frame.set(part, offset);
+                offset += part.byteLength;
+            }
+            this.frameParts = [];
+            this.framePartsFrameIndex = undefined;
+            this.decoder.decodeFrame(frame, header);
         }
     };
     WebStreamer.prototype.chooseVideoSize = function () {
@@ -1,5 +1,6 @@
 import * as $ from 'jquery';
 import { IVideoMode, getVideoModeText } from './ivideo-mode';
+import { FrameHeader } from './frame-header';
 
 export enum Codec {
     Raw = "raw",
@@ -13,6 +14,16 @@ export function getCodecId(codec: Codec) {
     }
 }
 
+// All values in milliseconds, the server values are measured with the clock of
+// the server and the client value depends on both clocks being synchronized.
+export interface Latencies {
+    // From pushing the frame on the server until it has been displayed
+    client: number;
+    // From pushing the frame until it has been encoded
+    server: number;
+    frameIndex: number;
+}
+
 export abstract class Decoder {
     public readonly codec: Codec;
     public abstract readonly domElement: HTMLElement;
@@ -30,6 +41,8 @@ export abstract class Decoder {
     }
     public onAvailableVideoModesChange: () => void;
 
+    public onLatencies: (latencies: Latencies) => void;
+
     public constructor(codec: Codec) {
         this.codec = codec;
         $(".decoder-settings").hide();
@@ -37,12 +50,23 @@ export abstract class Decoder {
     }
 
     public abstract configure(configuration: any);
-    public abstract decodeFrame(encodedFrame: ArrayBufferView);
+    public abstract decodeFrame(encodedFrame: ArrayBufferView, header: FrameHeader);
 
     public changeVideoMode(videoMode: IVideoMode) {
         $("#current-video-mode").text(getVideoModeText(videoMode));
     }
 
+    // Should be called after the frame has been displayed
+    protected reportLatencies(header: FrameHeader) {
+        if (this.onLatencies) {
+            this.onLatencies({
+                client: Date.now() - header.pushTimestamp,
+                server: header.encodeEndTimestamp - header.pushTimestamp,
+                frameIndex: header.frameIndex
+            });
+        }
+    }
+
     protected changeOptions(options: any) {
         this._options = options;
         if (this.onOptionsChanged) {
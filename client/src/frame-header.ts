@@ -0,0 +1,41 @@
+// Mirrors webstreamer::EncodedFrameHeader (encoded_frame_header.hpp) which
+// precedes the data of every encoded frame.
+export const FRAME_HEADER_SIZE = 40;
+
+// FrameHeader flags
+const LAST_PART = 1;
+
+export interface FrameHeader {
+    frameIndex: number;
+    width: number;
+    height: number;
+    // Timestamps in milliseconds since the Unix epoch (server clock)
+    pushTimestamp: number;
+    encodeStartTimestamp: number;
+    encodeEndTimestamp: number;
+    // Frames that are streamed while they are encoded consist of several
+    // parts that have to be concatenated, all other frames of a single part.
+    partIndex: number;
+    isLastPart: boolean;
+}
+
+function getTimestamp(dataView: DataView, offset: number): number {
+    // The server sends microseconds as 64 bit integers
+    const low = dataView.getUint32(offset, true);
+    const high = dataView.getUint32(offset + 4, true);
+    return (high * 4294967296 + low) / 1000;
+}
+
+export function parseFrameHeader(data: ArrayBufferView): FrameHeader {
+    const dataView = new DataView(data.buffer, data.byteOffset, FRAME_HEADER_SIZE);
+    return {
+        frameIndex: dataView.getUint32(0, true),
+        width: dataView.getUint16(4, true),
+        height: dataView.getUint16(6, true),
+        pushTimestamp: getTimestamp(dataView, 8),
+        encodeStartTimestamp: getTimestamp(dataView, 16),
+        encodeEndTimestamp: getTimestamp(dataView, 24),
+        partIndex: dataView.getUint16(32, true),
+        isLastPart: (dataView.getUint16(34, true) & LAST_PART) !== 0,
+    };
+}
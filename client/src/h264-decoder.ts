@@ -1,14 +1,9 @@
-import { Decoder, Codec } from "./decoder";
+import { Decoder, Codec, Latencies } from "./decoder";
+import { FrameHeader } from "./frame-header";
 
 import { Player } from "broadway-player";
 import { IVideoMode } from "./ivideo-mode";
 
-interface Latencies {
-    client: number;
-    server: number;
-    frameIndex: number;
-}
-
 export class H264Decoder extends Decoder {
     public readonly domElement: HTMLCanvasElement;
 
@@ -30,8 +25,9 @@ export class H264Decoder extends Decoder {
         this.domElement = this.avc.canvas;
     }
 
-    public decodeFrame(frameData: ArrayBufferView): void {
-        this.avc.decode(new Uint8Array(frameData.buffer, frameData.byteOffset));
+    public decodeFrame(frameData: ArrayBufferView, header: FrameHeader): void {
+        this.avc.decode(new Uint8Array(frameData.buffer, frameData.byteOffset, frameData.byteLength));
+        this.reportLatencies(header);
     }
 
     public changeVideoMode(videoMode: IVideoMode) {
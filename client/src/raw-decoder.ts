@@ -1,14 +1,9 @@
 import { Decoder, Codec } from "./decoder";
+import { FrameHeader } from "./frame-header";
 
 import { Player } from "broadway-player";
 import { IVideoMode } from "./ivideo-mode";
 
-interface Latencies {
-    client: number;
-    server: number;
-    frameIndex: number;
-}
-
 export class RawDecoder extends Decoder {
     public readonly domElement: HTMLCanvasElement;
 
@@ -34,7 +29,7 @@ export class RawDecoder extends Decoder {
         throw new Error("Method not implemented.");
     }
 
-    public decodeFrame(frameData: ArrayBufferView): void {
+    public decodeFrame(frameData: ArrayBufferView, header: FrameHeader): void {
         if (!this.buffer || this.buffer.width * this.buffer.height * 3 !== frameData.byteLength) {
             console.info("Invalid byte length of encoded frame.");
             return;
@@ -53,6 +48,7 @@ export class RawDecoder extends Decoder {
             }
         }
         this.context.putImageData(this.buffer, 0, 0);
+        this.reportLatencies(header);
     }
 
     public changeVideoMode(videoMode: IVideoMode) {
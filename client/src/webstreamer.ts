@@ -1,6 +1,7 @@
 import * as $ from 'jquery';
 import { Stream, StreamType } from "./stream"
-import { Decoder, Codec } from "./decoder";
+import { Decoder, Codec, Latencies } from "./decoder";
+import { FRAME_HEADER_SIZE, FrameHeader, parseFrameHeader } from "./frame-header";
 import { StatGraph } from "./stat-graph";
 import { parseMouseEvent, parseKeyEvent } from "./input";
 import { deserializeEvent, EventType, serializeEvent } from "./events";
@@ -15,8 +16,11 @@ import { IVideoMode } from "./ivideo-mode";
 import { WebRTCStream } from './webrtc-stream';
 import { InputCapturer } from './input-capturer';
 import { Clipboard } from './clipboard';
+import { getQueryVariable } from './getQueryVariable';
 
 export class WebStreamer {
+    public onLatencies: (latencies: Latencies) => void;
+
     private streamConfig: any;
     private decoder: Decoder;
     private stream: Stream;
@@ -25,6 +29,8 @@ export class WebStreamer {
     private isStopped = false;
     private currentVideoMode: IVideoMode = null;
     private inputCapturer: InputCapturer = new InputCapturer();
+    private frameParts: Uint8Array[] = [];
+    private framePartsFrameIndex: number;
 
     constructor() {
         AJAXGetTextRequest("stream_config.json",
@@ -104,7 +110,7 @@ export class WebStreamer {
                     this.stream.sendEvent({
                         type: EventType.ChangeCodec,
                         codec: this.decoder.codec,
-                        options: this.decoder.options
+                        options: this.getCodecOptions()
                     });
                 }
             };
@@ -145,12 +151,17 @@ export class WebStreamer {
 
         if (this.decoder) {
             this.decoder.onAvailableVideoModesChange = () => this.chooseVideoMode();
+            this.decoder.onLatencies = (latencies) => {
+                if (this.onLatencies) {
+                    this.onLatencies(latencies);
+                }
+            };
             this.decoder.onOptionsChanged = () => {
                 if (this.stream && this.stream.isConnected) {
                     this.stream.sendEvent({
                         type: EventType.ChangeCodec,
                         codec: this.decoder.codec,
-                        options: this.decoder.options
+                        options: this.getCodecOptions()
                     });
                 }
             }
@@ -189,9 +200,68 @@ export class WebStreamer {
 			//this.selectStream(StreamType.WebRTC);
     }
 
+    // The server streams the frames of the source given in the URL, e.g.,
+    // "?source=name", or the frames of its default source otherwise.
+    private getCodecOptions(): any {
+        const options = {};
+        for (let key in this.decoder.options) {
+            options[key] = this.decoder.options[key];
+        }
+        const source = getQueryVariable("source");
+        if (source) {
+            options["source"] = source;
+        }
+        return options;
+    }
+
     private onVideoData(encodedFrame: ArrayBufferView) {
+        if (encodedFrame.byteLength < FRAME_HEADER_SIZE) {
+            console.warn("Received frame without header");
+            return;
+        }
         if (!this.isStopped && this.decoder) {
-            this.decoder.decodeFrame(encodedFrame);
+            const header = parseFrameHeader(encodedFrame);
+            const frameData = new Uint8Array(
+                encodedFrame.buffer,
+                encodedFrame.byteOffset + FRAME_HEADER_SIZE,
+                encodedFrame.byteLength - FRAME_HEADER_SIZE);
+            if (header.partIndex === 0 && header.isLastPart) {
+                this.decoder.decodeFrame(frameData, header);
+            } else {
+                this.onVideoDataPart(frameData, header);
+            }
+        }
+    }
+
+    // Collects the parts of a frame and decodes the frame once its last part
+    // has arrived. Frames with missing parts are skipped.
+    private onVideoDataPart(frameData: Uint8Array, header: FrameHeader) {
+        if (header.partIndex === 0) {
+            this.frameParts = [];
+            this.framePartsFrameIndex = header.frameIndex;
+        } else if (header.frameIndex !== this.framePartsFrameIndex ||
+                   header.partIndex !== this.frameParts.length) {
+            console.warn("Received incomplete frame");
+            this.frameParts = [];
+            this.framePartsFrameIndex = undefined;
+            return;
+        }
+        this.frameParts.push(frameData);
+
+        if (header.isLastPart) {
+            let size = 0;
+            for (const part of this.frameParts) {
+                size += part.byteLength;
+            }
+            const frame = new Uint8Array(size);
+            let offset = 0;
+            for (const part of this.frameParts) {
+                frame.set(part, offset);
+                offset += part.byteLength;
+            }
+            this.frameParts = [];
+            this.framePartsFrameIndex = undefined;
+            this.decoder.decodeFrame(frame, header);
         }
     }
 
@@ -0,0 +1,134 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "webstreamer/frame_copy.hpp"
+#include "webstreamer/worker_pool.hpp"
+
+namespace {
+
+struct Resolution {
+  const char* name;
+  std::size_t width;
+  std::size_t height;
+};
+
+// The loop that was used by EncodingPipeline::PushFrame() before CopyRows()
+void ReferenceFlip(std::uint8_t* destination, const std::uint8_t* source,
+                   std::size_t stride, std::size_t height) {
+  for (std::size_t row = height; row != 0; --row, source += stride) {
+    std::memcpy(destination + (row - 1) * stride, source, stride);
+  }
+}
+
+template <typename Function>
+double MeasureGigabytesPerSecond(std::size_t bytes, int iterations,
+                                 Function&& function) {
+  function();  // Warm up
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    function();
+  }
+  const std::chrono::duration<double> elapsed_time =
+      std::chrono::steady_clock::now() - start;
+  return static_cast<double>(bytes) * iterations / elapsed_time.count() / 1e9;
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+  if (argc >= 2 &&
+      (std::strcmp(argv[1], "--help") == 0 ||
+       std::strcmp(argv[1], "help") == 0 || std::strcmp(argv[1], "-h") == 0)) {
+    std::cout << "usage: copy-benchmark [iterations=50] [threads=auto]"
+              << std::endl;
+    return 0;
+  }
+
+  const int iterations = argc >= 2 ? std::atoi(argv[1]) : 50;
+  const std::size_t thread_count =
+      argc >= 3 ? static_cast<std::size_t>(std::atoi(argv[2]))
+                : std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+  const Resolution resolutions[] = {
+      {"720p", 1280, 720}, {"4K", 3840, 2160}, {"8K", 7680, 4320}};
+  webstreamer::WorkerPool worker_pool(thread_count);
+
+  std::cout << "Flipping RGB frames, " << iterations << " iterations, "
+            << thread_count << " worker thread(s), results in GB/s"
+            << std::endl;
+  std::cout << std::setw(6) << "" << std::setw(12) << "reference"
+            << std::setw(12) << "CopyRows" << std::setw(12) << "parallel"
+            << std::endl;
+
+  for (const auto& resolution : resolutions) {
+    const std::size_t stride = ((resolution.width * 3 + 3) / 4) * 4;
+    const std::size_t size = stride * resolution.height;
+    std::vector<std::uint8_t> source(size);
+    std::vector<std::uint8_t> reference(size);
+    std::vector<std::uint8_t> destination(size);
+    for (std::size_t i = 0; i < size; ++i) {
+      source[i] = static_cast<std::uint8_t>(i * 7 + i / 4096);
+    }
+
+    const double reference_speed =
+        MeasureGigabytesPerSecond(size, iterations, [&]() {
+          ReferenceFlip(reference.data(), source.data(), stride,
+                        resolution.height);
+        });
+    const double single_threaded_speed =
+        MeasureGigabytesPerSecond(size, iterations, [&]() {
+          webstreamer::CopyRows(destination.data(), stride, source.data(),
+                                stride, stride, resolution.height, true);
+        });
+    if (destination != reference) {
+      std::cerr << "CopyRows() produced a wrong result" << std::endl;
+      return 1;
+    }
+    std::fill(destination.begin(), destination.end(), std::uint8_t(0));
+    const double parallel_speed =
+        MeasureGigabytesPerSecond(size, iterations, [&]() {
+          webstreamer::CopyRows(destination.data(), stride, source.data(),
+                                stride, stride, resolution.height, true,
+                                &worker_pool);
+        });
+    if (destination != reference) {
+      std::cerr << "Parallel CopyRows() produced a wrong result" << std::endl;
+      return 1;
+    }
+
+    std::cout << std::fixed << std::setprecision(2) << std::setw(6)
+              << resolution.name << std::setw(12) << reference_speed
+              << std::setw(12) << single_threaded_speed << std::setw(12)
+              << parallel_speed << std::endl;
+  }
+
+  return 0;
+}
@@ -24,12 +24,18 @@
 #include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <string>
+#include <thread>
 #include <vector>
 #include "webstreamer/console_logger.hpp"
 #include "webstreamer/file_logger.hpp"
 #include "webstreamer/stop_watch.hpp"
 #include "webstreamer/webstreamer.hpp"
+#ifdef NOISE_STREAM_ENABLE_SHARED_MEMORY
+#include "webstreamer/shared_memory_producer.hpp"
+#endif
 
 int main(int argc, const char** argv) {
   using webstreamer::ConsoleLogger;
@@ -41,11 +47,27 @@ int main(int argc, const char** argv) {
   if (argc >= 2 &&
       (std::strcmp(argv[1], "--help") == 0 ||
        std::strcmp(argv[1], "help") == 0 || std::strcmp(argv[1], "-h") == 0)) {
-    std::cout << "usage: noise-stream [width=1280] [height=720] [fps=60]"
+    std::cout << "usage: noise-stream [width=1280] [height=720] [fps=60]\n"
+              << "       noise-stream --shm <name> [width] [height] [fps]\n"
+              << "       noise-stream --shm-ingest <name>\n"
+              << "\n"
+              << "--shm only produces frames and passes them to the process\n"
+              << "started with --shm-ingest through shared memory."
               << std::endl;
     return 0;
   }
 
+  // Shared memory mode (see SharedMemoryProducer and SharedMemoryIngest)
+  std::string shared_memory_name;
+  bool is_shared_memory_producer = false;
+  if (argc >= 3 && (std::strcmp(argv[1], "--shm") == 0 ||
+                    std::strcmp(argv[1], "--shm-ingest") == 0)) {
+    shared_memory_name = argv[2];
+    is_shared_memory_producer = std::strcmp(argv[1], "--shm") == 0;
+    argc -= 2;
+    argv += 2;
+  }
+
   const int width = argc >= 2 ? std::atoi(argv[1]) : 1280;
   const int height = argc >= 3 ? std::atoi(argv[2]) : 720;
   const int fps = argc >= 4 ? std::atoi(argv[3]) : 60;
@@ -61,7 +83,26 @@ int main(int argc, const char** argv) {
   CreateImmortalLogListener<ConsoleLogger>(LogLevel::DEBUG);
   CreateImmortalLogListener<FileLogger>(LogLevel::VERBOSE);
 
-  WebStreamer web_streamer;
+#ifdef NOISE_STREAM_ENABLE_SHARED_MEMORY
+  std::unique_ptr<webstreamer::SharedMemoryProducer> shared_memory_producer;
+  if (is_shared_memory_producer) {
+    shared_memory_producer =
+        std::make_unique<webstreamer::SharedMemoryProducer>(
+            shared_memory_name, width, height);
+  }
+#else
+  if (!shared_memory_name.empty()) {
+    std::cerr << "Shared memory is not supported on this platform"
+              << std::endl;
+    return 1;
+  }
+#endif
+
+  // The producer does not need a server
+  std::unique_ptr<WebStreamer> web_streamer;
+  if (!is_shared_memory_producer) {
+    web_streamer = std::make_unique<WebStreamer>();
+  }
 
   class InputProcessor : public webstreamer::AsynchronousInputProcessor {
   public:
@@ -73,7 +114,16 @@ int main(int argc, const char** argv) {
 	  }
   };
   InputProcessor input_processor;
-  web_streamer.RegisterInputProcessor(&input_processor);
+  if (web_streamer != nullptr) {
+    web_streamer->RegisterInputProcessor(&input_processor);
+  }
+
+  if (!shared_memory_name.empty() && !is_shared_memory_producer) {
+    web_streamer->StartSharedMemoryIngest(shared_memory_name);
+    while (true) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+  }
 
   const auto frame_interval =
       fps == 0 ? std::chrono::microseconds(0)
@@ -99,10 +149,30 @@ int main(int argc, const char** argv) {
     }
     frame_stopwatch.Subtract(frame_interval);
 
+    // The producer renders directly into the shared memory
+    std::uint32_t* frame_values = u32_image_values;
+#ifdef NOISE_STREAM_ENABLE_SHARED_MEMORY
+    if (shared_memory_producer != nullptr) {
+      frame_values = static_cast<std::uint32_t*>(
+          shared_memory_producer->AcquireWriteFrame(width, height));
+      if (frame_values == nullptr) {
+        // No free slot, drop the frame
+        continue;
+      }
+    }
+#endif
+
     for (std::size_t i = 0; i < u32_image_values_count; ++i) {
-      u32_image_values[i] = distribution(random_number_generator_engine);
+      frame_values[i] = distribution(random_number_generator_engine);
+    }
+
+#ifdef NOISE_STREAM_ENABLE_SHARED_MEMORY
+    if (shared_memory_producer != nullptr) {
+      shared_memory_producer->CommitFrame();
+      continue;
     }
-    web_streamer.PushFrame(width, height, image.data(), image.size());
+#endif
+    web_streamer->PushFrame(width, height, image.data(), image.size());
     // ++frame_counter;
   }
 
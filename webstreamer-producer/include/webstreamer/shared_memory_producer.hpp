@@ -0,0 +1,87 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_PRODUCER_INCLUDE_WEBSTREAMER_SHARED_MEMORY_PRODUCER_HPP_
+#define WEBSTREAMER_PRODUCER_INCLUDE_WEBSTREAMER_SHARED_MEMORY_PRODUCER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "webstreamer/frame_buffer.hpp"
+#include "webstreamer/producer_export.hpp"
+#include "webstreamer/shared_frame_ring.hpp"
+
+namespace webstreamer {
+
+const std::size_t DEFAULT_SHARED_MEMORY_SLOT_COUNT = 3;
+
+// Publishes frames through a shared memory segment that a WebStreamer in
+// another process reads with SharedMemoryIngest (see the ingest.sharedMemory
+// option). The segment is created by the producer and is large enough for
+// frames of max_width x max_height pixels in any pixel format. An existing
+// segment with the same name is replaced, so the producer can be restarted
+// while the WebStreamer keeps running. Throws std::system_error if the segment
+// cannot be created.
+class WEBSTREAMER_PRODUCER_EXPORT SharedMemoryProducer {
+ public:
+  SharedMemoryProducer(
+      const std::string& name, std::size_t max_width, std::size_t max_height,
+      std::size_t slot_count = DEFAULT_SHARED_MEMORY_SLOT_COUNT);
+  ~SharedMemoryProducer();
+
+  SharedMemoryProducer(const SharedMemoryProducer&) = delete;
+  SharedMemoryProducer& operator=(const SharedMemoryProducer&) = delete;
+
+  // Same as WebStreamer::PushFrame(). Returns false and drops the frame if it
+  // does not fit into a slot, if size_in_bytes is smaller than the layout of
+  // the frame requires or if no slot is free.
+  bool PushFrame(std::size_t width, std::size_t height, const void* data,
+                 std::size_t size_in_bytes, bool flip_vertically = false,
+                 PixelFormat pixel_format = PixelFormat::RGB);
+
+  // Returns a slot in the shared memory segment the frame can be rendered into
+  // directly. The layout is the one PushFrame() expects, i.e., rows are aligned
+  // to PUSH_FRAME_STRIDE_ALIGNMENT bytes. Every call must be followed by a
+  // call to CommitFrame() before the next frame is acquired. Returns nullptr if
+  // the frame does not fit into a slot or if no slot is free, e.g., because a
+  // consumer died while it was reading a slot. The frame must be dropped then
+  // and CommitFrame() must not be called.
+  void* AcquireWriteFrame(std::size_t width, std::size_t height,
+                          PixelFormat pixel_format = PixelFormat::RGB,
+                          bool flip_vertically = false);
+
+  // Publishes the frame returned by the last call to AcquireWriteFrame().
+  void CommitFrame();
+
+  inline std::size_t slot_capacity() const { return slot_capacity_; }
+
+ private:
+  std::string path_;
+  std::size_t slot_capacity_;
+  std::size_t mapping_size_;
+  SharedFrameRingHeader* header_;
+  std::uint32_t write_slot_;
+};
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_PRODUCER_INCLUDE_WEBSTREAMER_SHARED_MEMORY_PRODUCER_HPP_
@@ -0,0 +1,198 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "webstreamer/shared_memory_producer.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <system_error>
+
+namespace webstreamer {
+
+namespace {
+
+std::size_t CalculateSlotCapacity(std::size_t max_width,
+                                  std::size_t max_height) {
+  // RGBA and BGRA frames are the largest ones
+  PlaneLayout planes[MAX_PLANE_COUNT];
+  return CalculateFrameLayout(max_width, max_height, PixelFormat::RGBA,
+                              PUSH_FRAME_STRIDE_ALIGNMENT, planes);
+}
+
+}  // namespace
+
+SharedMemoryProducer::SharedMemoryProducer(const std::string& name,
+                                           std::size_t max_width,
+                                           std::size_t max_height,
+                                           std::size_t slot_count)
+    : path_(GetSharedFrameRingPath(name)),
+      slot_capacity_(CalculateSlotCapacity(max_width, max_height)),
+      mapping_size_(GetSharedFrameRingSize(slot_count, slot_capacity_)),
+      header_(nullptr),
+      write_slot_(SHARED_FRAME_RING_NO_SLOT) {
+  // The consumer needs one slot and the latest frame must not be overwritten
+  assert(slot_count >= 3);
+
+  // Replace the segment of a previous producer so a consumer that is still
+  // attached to it notices the restart (see SharedMemoryIngest).
+  shm_unlink(path_.c_str());
+  const int file_descriptor =
+      shm_open(path_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (file_descriptor < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Failed to create shared memory " + path_);
+  }
+
+  if (ftruncate(file_descriptor, static_cast<off_t>(mapping_size_)) != 0) {
+    const int error = errno;
+    close(file_descriptor);
+    shm_unlink(path_.c_str());
+    throw std::system_error(error, std::generic_category(),
+                            "Failed to resize shared memory " + path_);
+  }
+
+  void* mapping = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, file_descriptor, 0);
+  const int error = errno;
+  close(file_descriptor);
+  if (mapping == MAP_FAILED) {
+    shm_unlink(path_.c_str());
+    throw std::system_error(error, std::generic_category(),
+                            "Failed to map shared memory " + path_);
+  }
+
+  // ftruncate() zeroed the segment, so magic is not valid until it is stored
+  // below.
+  header_ = new (mapping) SharedFrameRingHeader;
+  header_->version = SHARED_FRAME_RING_VERSION;
+  header_->slot_count = static_cast<std::uint32_t>(slot_count);
+  header_->slot_capacity = slot_capacity_;
+  header_->latest_slot.store(SHARED_FRAME_RING_NO_SLOT,
+                             std::memory_order_relaxed);
+  header_->sequence.store(0, std::memory_order_relaxed);
+  header_->consumer_waiting.store(0, std::memory_order_relaxed);
+
+  SharedFrameSlot* const slots = GetSharedFrameSlots(header_);
+  for (std::size_t i = 0; i < slot_count; ++i) {
+    new (&slots[i]) SharedFrameSlot;
+    slots[i].reference_count.store(0, std::memory_order_relaxed);
+    slots[i].data_offset =
+        GetSharedFrameDataOffset(slot_count, slot_capacity_, i);
+  }
+
+  header_->magic.store(SHARED_FRAME_RING_MAGIC, std::memory_order_release);
+}
+
+SharedMemoryProducer::~SharedMemoryProducer() {
+  munmap(header_, mapping_size_);
+  shm_unlink(path_.c_str());
+}
+
+bool SharedMemoryProducer::PushFrame(std::size_t width, std::size_t height,
+                                     const void* data,
+                                     std::size_t size_in_bytes,
+                                     bool flip_vertically,
+                                     PixelFormat pixel_format) {
+  // Publishing a truncated frame would show garbage
+  PlaneLayout planes[MAX_PLANE_COUNT];
+  if (size_in_bytes < CalculateFrameLayout(width, height, pixel_format,
+                                           PUSH_FRAME_STRIDE_ALIGNMENT,
+                                           planes)) {
+    return false;
+  }
+
+  void* frame =
+      AcquireWriteFrame(width, height, pixel_format, flip_vertically);
+  if (frame == nullptr) {
+    return false;
+  }
+
+  std::memcpy(frame, data,
+              GetSharedFrameSlots(header_)[write_slot_].size_in_bytes);
+  CommitFrame();
+  return true;
+}
+
+void* SharedMemoryProducer::AcquireWriteFrame(std::size_t width,
+                                              std::size_t height,
+                                              PixelFormat pixel_format,
+                                              bool flip_vertically) {
+  assert(write_slot_ == SHARED_FRAME_RING_NO_SLOT);
+
+  PlaneLayout planes[MAX_PLANE_COUNT];
+  const std::size_t size_in_bytes = CalculateFrameLayout(
+      width, height, pixel_format, PUSH_FRAME_STRIDE_ALIGNMENT, planes);
+  if (size_in_bytes > slot_capacity_) {
+    return nullptr;
+  }
+
+  // There is only one consumer, so with three or more slots there is always a
+  // slot that is neither the latest nor pinned by the consumer. Slots pinned by
+  // a consumer that died are only released when the next one attaches, so the
+  // frame is dropped instead of waiting for a free slot.
+  SharedFrameSlot* const slots = GetSharedFrameSlots(header_);
+  const std::uint32_t latest_slot =
+      header_->latest_slot.load(std::memory_order_relaxed);
+  for (std::uint32_t i = 0;
+       i < header_->slot_count && write_slot_ == SHARED_FRAME_RING_NO_SLOT;
+       ++i) {
+    std::uint32_t expected_reference_count = 0;
+    if (i != latest_slot &&
+        slots[i].reference_count.compare_exchange_strong(
+            expected_reference_count, SHARED_FRAME_RING_WRITING,
+            std::memory_order_acquire, std::memory_order_relaxed)) {
+      write_slot_ = i;
+    }
+  }
+  if (write_slot_ == SHARED_FRAME_RING_NO_SLOT) {
+    return nullptr;
+  }
+
+  SharedFrameSlot* const slot = &slots[write_slot_];
+  slot->width = static_cast<std::uint32_t>(width);
+  slot->height = static_cast<std::uint32_t>(height);
+  slot->pixel_format = static_cast<std::uint32_t>(pixel_format);
+  slot->flip_vertically = flip_vertically ? 1 : 0;
+  slot->size_in_bytes = size_in_bytes;
+  return reinterpret_cast<std::uint8_t*>(header_) + slot->data_offset;
+}
+
+void SharedMemoryProducer::CommitFrame() {
+  assert(write_slot_ != SHARED_FRAME_RING_NO_SLOT);
+
+  GetSharedFrameSlots(header_)[write_slot_].reference_count.store(
+      0, std::memory_order_release);
+  header_->latest_slot.store(write_slot_, std::memory_order_release);
+  header_->sequence.fetch_add(1, std::memory_order_release);
+  write_slot_ = SHARED_FRAME_RING_NO_SLOT;
+
+  if (header_->consumer_waiting.load() != 0) {
+    WakeSharedFrameRingConsumer(&header_->sequence);
+  }
+}
+
+}  // namespace webstreamer
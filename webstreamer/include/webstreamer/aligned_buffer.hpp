@@ -0,0 +1,68 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_ALIGNED_BUFFER_HPP_
+#define WEBSTREAMER_INCLUDE_WEBSTREAMER_ALIGNED_BUFFER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include "webstreamer/export.hpp"
+
+namespace webstreamer {
+
+// A byte buffer whose storage is aligned to a cache line. Unlike
+// std::vector, growing the buffer neither initializes nor preserves its
+// contents and shrinking it keeps the allocation. Large buffers can
+// optionally be backed by transparent huge pages (Linux only) to reduce TLB
+// misses when they are traversed.
+class WEBSTREAMER_EXPORT AlignedBuffer {
+ public:
+  static const std::size_t ALIGNMENT = 64;
+  static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+  inline AlignedBuffer() : data_(nullptr), size_(0), capacity_(0) {}
+  AlignedBuffer(const AlignedBuffer& other);
+  AlignedBuffer(AlignedBuffer&& other);
+  ~AlignedBuffer();
+
+  AlignedBuffer& operator=(const AlignedBuffer& other);
+  AlignedBuffer& operator=(AlignedBuffer&& other);
+
+  inline std::uint8_t* data() { return data_; }
+  inline const std::uint8_t* data() const { return data_; }
+  inline std::size_t size() const { return size_; }
+  inline std::size_t capacity() const { return capacity_; }
+
+  // Huge pages are only used for buffers of at least HUGE_PAGE_SIZE bytes.
+  void Resize(std::size_t size, bool use_huge_pages = false);
+
+ private:
+  std::uint8_t* data_;
+  std::size_t size_;
+  std::size_t capacity_;
+
+  void Free();
+};
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_INCLUDE_WEBSTREAMER_ALIGNED_BUFFER_HPP_
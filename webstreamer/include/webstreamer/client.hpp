@@ -23,8 +23,13 @@
 #ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_CLIENT_HPP_
 #define WEBSTREAMER_INCLUDE_WEBSTREAMER_CLIENT_HPP_
 
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <mutex>
+#include <thread>
 #include <vector>
 #include "webstreamer/encoder.hpp"
 #include "webstreamer/event.hpp"
@@ -32,9 +37,21 @@
 
 namespace webstreamer {
 
+class ClientSet;
 class EncodingPipeline;
 struct EncodedFrame;
 
+// Clients that fall behind drop frames to catch up. The thresholds refer to the
+// bytes that wait to be sent to the client, i.e., the frames in its send queue
+// and the data buffered by its connection.
+struct FrameDropPolicy {
+  // Above this, frames that no other frame refers to are dropped
+  std::size_t non_reference_threshold_in_bytes = 2 * 1024 * 1024;
+  // Above this, the queued frames are discarded and all frames are dropped
+  // until the next keyframe, which the client requests from its encoder
+  std::size_t keyframe_threshold_in_bytes = 8 * 1024 * 1024;
+};
+
 struct ClientEvent {
 #if defined(_MSC_VER) && _MSC_VER < 1900
   // VS 2013 cannot generate the default move constructor and move assignment
@@ -63,14 +80,31 @@ class WEBSTREAMER_EXPORT Client {
   friend class ClientSet;
 
  public:
-  virtual ~Client() = default;
+  Client();
+  virtual ~Client();
 
   inline bool is_alive() const { return is_alive_; }
   inline bool is_playing() const { return is_playing_; }
   inline bool is_active() const { return is_alive() && is_playing(); }
 
-  void PushFrame(const EncodedFrame& encoded_frame);
+  // Queues the frame, which is sent to the client by its send thread. Only
+  // the reference to the serialized frame is copied, so this never blocks on
+  // the connection of the client. Returns false if the client fell too far
+  // behind and the encoder should produce a keyframe (see FrameDropPolicy).
+  bool PushFrame(const EncodedFrame& encoded_frame);
+
+  void set_frame_drop_policy(const FrameDropPolicy& frame_drop_policy);
+
+  // The number of frames that were dropped because the client fell behind
+  inline std::uint64_t dropped_frame_count() const {
+    return dropped_frame_count_.load(std::memory_order_relaxed);
+  }
+  // The number of keyframes the client requested to catch up
+  inline std::uint64_t requested_keyframe_count() const {
+    return requested_keyframe_count_.load(std::memory_order_relaxed);
+  }
 
+  // Called on the send thread of the client
   virtual void OnFrameEncoded(const EncodedFrame& encoded_frame) = 0;
   virtual void OnCodecSwitched(Codec codec, const CodecOptions& options) = 0;
   virtual void SendEvent(const Event& event) = 0;
@@ -91,24 +125,82 @@ class WEBSTREAMER_EXPORT Client {
   // Should be called whenever the client receives an event.
   void AddEvent(Event::Ptr event);
 
+  // The number of bytes the connection accepted but has not sent yet. Counts
+  // towards the thresholds of the frame drop policy.
+  void set_buffered_amount(std::size_t buffered_amount);
+
+  // Starts the send thread, which calls the virtual functions above. Called by
+  // the client set when the client is inserted, i.e., once the derived class
+  // is constructed completely.
+  void StartSending();
+
+  // Stops the send thread and discards the queued frames. Derived classes
+  // have to call this in their destructor before they release anything that
+  // OnFrameEncoded() uses.
+  void StopSending();
+
  private:
-  bool is_alive_ = true;
-  bool is_playing_ = true;
+  // Read by the send thread and the encoders
+  std::atomic<bool> is_alive_{true};
+  std::atomic<bool> is_playing_{true};
   bool owns_input_token_ = false;
 
+  // Set when the client is inserted into a client set. Used to wake up the
+  // update thread of the set whenever there is something to process.
+  std::atomic<ClientSet*> client_set_{nullptr};
+
+  // The pipeline of the source the client is registered at. Only accessed by
+  // the client set.
+  EncodingPipeline* encoding_pipeline_ = nullptr;
+
   std::mutex requested_codec_mutex_;
   bool requested_codec_new_codec_ = false;
+  // Set while the requested source does not exist, only accessed by the
+  // client set
+  bool is_waiting_for_source_ = false;
   Codec requested_codec_;
   CodecOptions requested_codec_options_;
 
   std::mutex events_mutex_;
   std::vector<ClientEvent> events_;
 
+  std::mutex send_queue_mutex_;
+  std::condition_variable send_queue_condition_;
+  std::deque<EncodedFrame> send_queue_;
+  std::size_t send_queue_size_in_bytes_ = 0;
+  std::size_t buffered_amount_ = 0;
+  bool is_sending_stopped_ = false;
+  FrameDropPolicy frame_drop_policy_;
+  // Set when the client fell too far behind, cleared by the next keyframe.
+  // The keyframe is requested once the connection caught up, so a stalled
+  // connection does not cause a keyframe for every frame.
+  bool is_waiting_for_keyframe_ = false;
+  bool has_requested_keyframe_ = false;
+  // The remaining parts of a dropped frame are dropped as well
+  bool is_dropping_frame_ = false;
+  std::uint64_t dropping_frame_index_ = 0;
+  // Announced by the send thread before it sends the frames of the new codec
+  bool has_pending_codec_switch_ = false;
+  Codec pending_codec_;
+  CodecOptions pending_codec_options_;
+  std::atomic<std::uint64_t> dropped_frame_count_{0};
+  std::atomic<std::uint64_t> requested_keyframe_count_{0};
+  std::thread send_thread_;
+
   // Returns whether a new codec has been requested since the last call to
   // this functions.
   bool HasRequestedNewCodec(Codec* codec, CodecOptions* options);
+  // Keeps a request that could not be served yet pending, unless the client
+  // requested another codec in the meantime
+  void KeepRequestedCodec(Codec codec, const CodecOptions& options);
+  // Queues the call to OnCodecSwitched(), must be called before the client is
+  // registered at the new encoder
   void SetNewCodec(Codec codec, const CodecOptions& options);
   void InsertEvents(std::vector<ClientEvent>* events);
+  void RequestUpdate();
+  // Discards the frames of the previous encoder after a codec switch
+  void ClearSendQueue();
+  void SendThread();
 };
 
 }  // namespace webstreamer
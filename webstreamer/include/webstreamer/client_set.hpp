@@ -23,8 +23,13 @@
 #ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_CLIENT_SET_HPP_
 #define WEBSTREAMER_INCLUDE_WEBSTREAMER_CLIENT_SET_HPP_
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <type_traits>
 #include <vector>
@@ -36,9 +41,20 @@ namespace webstreamer {
 class EncodingPipeline;
 class InputProcessor;
 
+const std::chrono::milliseconds DEFAULT_CLIENT_UPDATE_BACKOFF(100);
+
+// Clients select a source with the "source" value of their codec options.
+// Clients that do not specify a source receive the frames of the default
+// source.
+const char* const SOURCE_CODEC_OPTION = "source";
+
 class WEBSTREAMER_EXPORT ClientSet {
  public:
-  explicit ClientSet(EncodingPipeline* encoding_pipeline);
+  // The update thread sleeps until a client receives an event, requests a new
+  // codec or dies but wakes up at least once per idle_backoff.
+  explicit ClientSet(
+      EncodingPipeline* default_encoding_pipeline,
+      std::chrono::milliseconds idle_backoff = DEFAULT_CLIENT_UPDATE_BACKOFF);
 
   template <typename T, typename... Args>
   void Insert(Args&&... constructor_arguments) {
@@ -46,22 +62,43 @@ class WEBSTREAMER_EXPORT ClientSet {
                   "T must be a dervied class of Client");
     static_assert(std::is_constructible<T, Args...>::value,
                   "The class is not constructible with the given arguments");
-    std::lock_guard<std::mutex> lock(vector_access_mutex_);
-    clients_.emplace_back(
-        std::make_unique<T>(std::forward<Args>(constructor_arguments)...));
+    Insert(std::make_unique<T>(std::forward<Args>(constructor_arguments)...));
   }
   void Insert(std::unique_ptr<Client> client);
   void UpdateClients();
+  void RequestUpdate();
   void OnStreamConfigChanged();
   void SetInputProcessor(InputProcessor* input_processor);
 
+  // Makes the pipeline available to clients under the given source id. The
+  // pipeline must outlive the client set.
+  void AddSource(const std::string& source_id,
+                 EncodingPipeline* encoding_pipeline);
+
+  // Applies to all clients, including the ones inserted later
+  void SetFrameDropPolicy(const FrameDropPolicy& frame_drop_policy);
+
+  // Summed up over all clients that have been inserted, see
+  // Client::dropped_frame_count() and Client::requested_keyframe_count()
+  std::uint64_t dropped_frame_count();
+  std::uint64_t requested_keyframe_count();
+
  private:
-  EncodingPipeline* encoding_pipeline_;
+  EncodingPipeline* default_encoding_pipeline_;
+  std::map<std::string, EncodingPipeline*> encoding_pipelines_;
   std::vector<std::unique_ptr<Client>> clients_;
   Client* input_client_ = nullptr;
   std::mutex vector_access_mutex_;
   std::vector<ClientEvent> events_;
+  FrameDropPolicy frame_drop_policy_;
+  // The counters of the clients that have been removed
+  std::uint64_t removed_clients_dropped_frame_count_ = 0;
+  std::uint64_t removed_clients_requested_keyframe_count_ = 0;
 
+  std::mutex update_mutex_;
+  std::condition_variable update_requested_condition_;
+  bool update_requested_ = false;
+  std::chrono::milliseconds idle_backoff_;
   std::thread update_thread_;
 
   std::mutex input_processor_mutex_;
@@ -69,6 +106,8 @@ class WEBSTREAMER_EXPORT ClientSet {
 
   void UpdateThread();
   void ProcessEvents();
+  // Returns nullptr if the options refer to an unknown source.
+  EncodingPipeline* GetEncodingPipeline(const CodecOptions& options);
 };
 
 }  // namespace webstreamer
@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_COLOR_CONVERSION_HPP_
+#define WEBSTREAMER_INCLUDE_WEBSTREAMER_COLOR_CONVERSION_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include "webstreamer/export.hpp"
+#include "webstreamer/frame_buffer.hpp"
+
+namespace webstreamer {
+
+class WorkerPool;
+
+enum class InstructionSet {
+  SCALAR,
+  SSE4_1,
+  AVX2,
+};
+
+// The best instruction set supported by the CPU, determined at runtime.
+WEBSTREAMER_EXPORT InstructionSet GetSupportedInstructionSet();
+
+// Converts a frame in a packed pixel format to I420 using the BT.601
+// coefficients for limited range video, i.e., the same conversion swscale
+// performs for AV_PIX_FMT_YUV420P. The chroma of each 2x2 block is computed
+// from the average of its four pixels. Large frames are split into slices of
+// rows that are converted on the worker pool (if one is given). The results
+// are identical for all instruction sets. instruction_set must be supported by
+// the CPU.
+WEBSTREAMER_EXPORT void ConvertToI420(
+    const void* source, std::size_t source_stride, PixelFormat source_format,
+    std::size_t width, std::size_t height, std::uint8_t* const* planes,
+    const std::size_t* strides, WorkerPool* worker_pool = nullptr,
+    InstructionSet instruction_set = GetSupportedInstructionSet());
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_INCLUDE_WEBSTREAMER_COLOR_CONVERSION_HPP_
@@ -0,0 +1,106 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_ENCODED_FRAME_HEADER_HPP_
+#define WEBSTREAMER_INCLUDE_WEBSTREAMER_ENCODED_FRAME_HEADER_HPP_
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "webstreamer/encoder.hpp"
+
+namespace webstreamer {
+
+// Precedes the data of every encoded frame that is sent to a client. All
+// values are little-endian and the timestamps are given in microseconds since
+// the Unix epoch. The client (client/src/frame-header.ts) relies on this
+// exact layout.
+struct EncodedFrameHeader {
+  std::uint32_t frame_index;
+  std::uint16_t width;
+  std::uint16_t height;
+  std::uint64_t push_timestamp;
+  std::uint64_t encode_start_timestamp;
+  std::uint64_t encode_end_timestamp;
+  // Frames that are streamed while they are encoded consist of several parts
+  // that the client concatenates, all other frames consist of a single part.
+  std::uint16_t part_index;
+  std::uint16_t flags;
+  std::uint32_t reserved;
+};
+static_assert(sizeof(EncodedFrameHeader) == 40, "");
+
+// EncodedFrameHeader::flags
+const std::uint16_t ENCODED_FRAME_LAST_PART = 1;
+
+// Layout of EncodedFrame::serialized_frame: the message type that the
+// WebSocket transport sends in front of every message, the header and the
+// encoded data. The WebSocket transport sends the whole buffer, WebRTC starts
+// at the header.
+const std::uint32_t ENCODED_FRAME_MESSAGE_TYPE = 2;
+const std::size_t ENCODED_FRAME_HEADER_OFFSET = sizeof(std::uint32_t);
+const std::size_t ENCODED_FRAME_DATA_OFFSET =
+    ENCODED_FRAME_HEADER_OFFSET + sizeof(EncodedFrameHeader);
+
+inline std::uint64_t GetMicrosecondsSinceEpoch(
+    std::chrono::system_clock::time_point time_point) {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          time_point.time_since_epoch())
+          .count());
+}
+
+inline EncodedFrameHeader CreateEncodedFrameHeader(
+    const EncodedFrame& encoded_frame) {
+  EncodedFrameHeader header;
+  header.frame_index = static_cast<std::uint32_t>(encoded_frame.frame_index);
+  header.width = static_cast<std::uint16_t>(encoded_frame.width);
+  header.height = static_cast<std::uint16_t>(encoded_frame.height);
+  header.push_timestamp =
+      GetMicrosecondsSinceEpoch(encoded_frame.push_timestamp);
+  header.encode_start_timestamp =
+      GetMicrosecondsSinceEpoch(encoded_frame.encode_start_timestamp);
+  header.encode_end_timestamp =
+      GetMicrosecondsSinceEpoch(encoded_frame.encode_end_timestamp);
+  header.part_index = static_cast<std::uint16_t>(encoded_frame.part_index);
+  header.flags = encoded_frame.is_last_part ? ENCODED_FRAME_LAST_PART : 0;
+  header.reserved = 0;
+  return header;
+}
+
+// Writes the message type and the header in front of the encoded data.
+inline void SerializeEncodedFrameHeader(
+    const EncodedFrame& encoded_frame,
+    std::vector<std::uint8_t>* serialized_frame) {
+  assert(serialized_frame->size() >= ENCODED_FRAME_DATA_OFFSET);
+  const EncodedFrameHeader header = CreateEncodedFrameHeader(encoded_frame);
+  std::memcpy(serialized_frame->data(), &ENCODED_FRAME_MESSAGE_TYPE,
+              sizeof(ENCODED_FRAME_MESSAGE_TYPE));
+  std::memcpy(serialized_frame->data() + ENCODED_FRAME_HEADER_OFFSET, &header,
+              sizeof(header));
+}
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_INCLUDE_WEBSTREAMER_ENCODED_FRAME_HEADER_HPP_
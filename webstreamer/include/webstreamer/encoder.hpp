@@ -23,8 +23,12 @@
 #ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_ENCODER_HPP_
 #define WEBSTREAMER_INCLUDE_WEBSTREAMER_ENCODER_HPP_
 
+#include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <vector>
 #include "webstreamer/export.hpp"
@@ -38,6 +42,7 @@ namespace webstreamer {
 
 class Client;
 class FrameBuffer;
+class WorkerPool;
 
 enum class Codec {
   RAW,
@@ -51,6 +56,32 @@ struct WEBSTREAMER_EXPORT EncodedFrame {
   std::size_t height;
   std::size_t size_in_bytes;
   const std::uint8_t* data;
+
+  // The frame is serialized once into an immutable buffer that is shared by
+  // all clients, data points into it. Transports send the serialized frame
+  // as it is instead of copying it (see encoded_frame_header.hpp).
+  std::shared_ptr<const std::vector<std::uint8_t>> serialized_frame;
+
+  // Set by Encoder::PushFrame(), see FrameInfo. Encoders that output frames
+  // with a delay set the index of the frame they output, 0 refers to the frame
+  // that is being encoded.
+  std::uint64_t frame_index = 0;
+  std::chrono::system_clock::time_point push_timestamp;
+  std::chrono::system_clock::time_point encode_start_timestamp;
+  std::chrono::system_clock::time_point encode_end_timestamp;
+
+  // See Encoder::SendEncodedFramePart()
+  std::size_t part_index = 0;
+  bool is_last_part = true;
+
+  // Whether clients can start decoding at this frame, i.e., an IDR frame or
+  // the start of an intra refresh wave. Newly registered clients only receive
+  // frames from the next keyframe on. Set explicitly by the encoders.
+  bool is_keyframe = false;
+
+  // Whether following frames depend on this frame. Clients that fall behind
+  // drop frames that are not referenced first (see FrameDropPolicy).
+  bool is_reference = true;
 };
 
 class WEBSTREAMER_EXPORT Encoder {
@@ -63,27 +94,142 @@ class WEBSTREAMER_EXPORT Encoder {
 
   virtual bool IsCompatible(const CodecOptions& configuration) = 0;
 
+  // The number of frames per second the encoder should produce at most. The
+  // encoding pipeline paces the encoder accordingly, 0 means that every frame
+  // is encoded.
+  virtual int framerate() const { return 0; }
+
+  // Encoders that prefer I420 receive packed frames converted to I420. The
+  // conversion is done once per frame and shared between all such encoders.
+  virtual bool prefers_i420() const { return false; }
+  // If such an encoder reports a preferred input size, it receives frames
+  // already scaled to that size. The scaled frames are taken from a resolution
+  // pyramid that is shared between all encoders. 0 keeps the frame size.
+  virtual std::size_t preferred_input_width() const { return 0; }
+  virtual std::size_t preferred_input_height() const { return 0; }
+
   void RegisterClient(Client* client);
   void DeregisterClient(Client* client);
 
-  void PushFrame(const FrameBuffer& frame_buffers);
+  // True if the next frame should be a keyframe, because a client waits for
+  // its first keyframe or fell behind and dropped frames (see FrameDropPolicy)
+  inline bool is_keyframe_requested() const {
+    return has_new_client() ||
+           is_keyframe_requested_.load(std::memory_order_relaxed);
+  }
+
+  // Frames that were published since the previous call but skipped count as
+  // dropped if the encoder missed the deadline of the frame, e.g., because
+  // encoding the previous frame took too long. Otherwise, they were skipped on
+  // purpose to meet the framerate and count as decimated.
+  void PushFrame(const FrameBuffer& frame_buffers,
+                 bool has_missed_deadline = true);
+
+  // Whether the encoder holds back frames, e.g., for its lookahead, i.e., it
+  // returns earlier frames than the one that is pushed (see
+  // EncodedFrame::frame_index).
+  virtual bool has_delayed_frames() { return false; }
+
+  // Sends the frames the encoder holds back by pushing the latest frame again
+  // until the encoder returns the frames pushed before. Encoders keep running
+  // afterwards, unlike x264 after flushing without input. Called by the
+  // encoding pipeline when no new frame arrives, so the last frames show up
+  // even if the content does not change anymore.
+  void Flush(const FrameBuffer& latest_frame_buffer);
+
+  // Set by the encoding pipeline before the first frame is encoded. Encoders
+  // may split their work across the pool, which is shared with the producer
+  // and the other encoders.
+  inline void set_worker_pool(WorkerPool* worker_pool) {
+    worker_pool_ = worker_pool;
+  }
 
   inline StopWatch<>::Duration idle_time() { return idle_time_.elapsed_time(); }
 
+  // The number of frames that were published while the encoder had active
+  // clients but that it could not encode in time, see PushFrame()
+  inline std::uint64_t dropped_frame_count() const {
+    return dropped_frame_count_.load(std::memory_order_relaxed);
+  }
+  // The number of frames that were skipped on purpose, because the producer
+  // publishes frames faster than the framerate of the encoder
+  inline std::uint64_t decimated_frame_count() const {
+    return decimated_frame_count_.load(std::memory_order_relaxed);
+  }
+
  protected:
-  inline bool has_new_client() const { return has_new_client_; }
-  virtual EncodedFrame EncodeFrame(const FrameBuffer& frame_buffer) = 0;
+  // True as long as a registered client waits for its first keyframe
+  inline bool has_new_client() const {
+    return waiting_client_count_.load(std::memory_order_relaxed) > 0;
+  }
+  inline WorkerPool* worker_pool() const { return worker_pool_; }
+  // Appends the encoded data to the serialized frame, which already contains
+  // the space for the header. The data and size of the returned frame are set
+  // by the caller.
+  virtual EncodedFrame EncodeFrame(
+      const FrameBuffer& frame_buffer,
+      std::vector<std::uint8_t>* serialized_frame) = 0;
+
+  // Sends a part of the frame that is being encoded to the clients right away,
+  // e.g., a slice that is finished before the rest of the frame. Encoders that
+  // send parts have to send the whole frame this way, the frame returned by
+  // EncodeFrame() is discarded then. Must only be called during EncodeFrame()
+  // and not concurrently.
+  void SendEncodedFramePart(std::size_t width, std::size_t height,
+                            const std::uint8_t* data, std::size_t size_in_bytes,
+                            bool is_keyframe, bool is_reference,
+                            bool is_last_part);
 
  private:
   CodecOptions codec_options_;
   Codec codec_;
 
-  std::vector<Client*> clients_;
+  struct RegisteredClient {
+    Client* client;
+    bool is_waiting_for_keyframe;
+  };
+  std::vector<RegisteredClient> clients_;
   std::mutex clients_access_mutex_;
-  bool has_new_client_ = false;
+  std::atomic<std::size_t> waiting_client_count_{0};
+  std::atomic<bool> is_keyframe_requested_{false};
 
-  StopWatch<> idle_time_;
+  // The frames since the last keyframe. They are replayed to clients that
+  // join, so these clients neither wait for nor force a keyframe. Protected by
+  // clients_access_mutex_.
+  std::vector<EncodedFrame> gop_cache_;
+  std::size_t gop_cache_size_in_bytes_ = 0;
+
+  void UpdateGopCache(const EncodedFrame& encoded_frame);
+  void ClearGopCache();
 
+  StopWatch<> idle_time_;
+  WorkerPool* worker_pool_ = nullptr;
+
+  std::uint64_t last_frame_index_ = 0;
+  std::size_t last_serialized_frame_size_ = 0;
+
+  // The frame that is being encoded, see SendEncodedFramePart()
+  EncodedFrame encoding_frame_ = EncodedFrame();
+  // The timestamps of the frames that have been pushed but not sent yet, see
+  // EncodedFrame::frame_index
+  struct PendingFrame {
+    std::uint64_t frame_index;
+    std::chrono::system_clock::time_point push_timestamp;
+    std::chrono::system_clock::time_point encode_start_timestamp;
+  };
+  std::deque<PendingFrame> pending_frames_;
+  std::atomic<std::uint64_t> dropped_frame_count_{0};
+  std::atomic<std::uint64_t> decimated_frame_count_{0};
+
+  // Completes a frame returned by EncodeFrame() and sends it unless it is
+  // empty
+  void SendEncodedFrame(
+      EncodedFrame* encoded_frame,
+      std::shared_ptr<std::vector<std::uint8_t>> serialized_frame);
+  // Completes the encoded frame with the serialized frame and sends it
+  void SendSerializedFrame(
+      EncodedFrame* encoded_frame,
+      std::shared_ptr<std::vector<std::uint8_t>> serialized_frame);
   void SendEncodedFrameToRegisteredClients(const EncodedFrame& encoded_frame);
 };
 
@@ -23,42 +23,116 @@
 #ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_ENCODING_PIPELINE_HPP_
 #define WEBSTREAMER_INCLUDE_WEBSTREAMER_ENCODING_PIPELINE_HPP_
 
-#if !defined(_MSC_VER) || \
-    _MSC_VER >= 1900  // shared_mutex is not supported on MSVC 12 and below
-#define SHARED_MUTEX_SUPPORTED 1
-#else
-#define SHARED_MUTEX_SUPPORTED 0
-#endif
-
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <map>
+#include <memory>
 #include <mutex>
-#if !defined(_MSC_VER) || \
-    _MSC_VER >= 1900  // shared_mutex is not supported on MSVC 12 and below
-#include <shared_mutex>
-#endif
 #include <thread>
+#include <vector>
 #include "webstreamer/encoder.hpp"
 #include "webstreamer/export.hpp"
 #include "webstreamer/frame_buffer.hpp"
+#include "webstreamer/frame_ring.hpp"
+#include "webstreamer/worker_pool.hpp"
 
 namespace webstreamer {
 
 class Client;
 class EncoderFactory;
 
+const std::size_t DEFAULT_FRAME_RING_SIZE = 4;
+const std::chrono::milliseconds DEFAULT_ENCODER_IDLE_BACKOFF(100);
+const std::size_t DEFAULT_WORKER_THREAD_COUNT = 2;
+
 class WEBSTREAMER_EXPORT EncodingPipeline {
  public:
-  EncodingPipeline();
+  // The frame ring should contain at least two frames more than there are
+  // encoders running concurrently. Otherwise, the producer has to wait for the
+  // encoders. The encoder threads sleep until a new frame is published but
+  // wake up at least once per idle_backoff. Encoders with a framerate only
+  // encode the latest frame once per frame interval. The worker pool helps the
+  // producer with copying and hashing large frames and may be shared between
+  // multiple pipelines. If no pool is given, the pipeline creates its own with
+  // DEFAULT_WORKER_THREAD_COUNT threads. See FrameBuffer for the stride
+  // alignment and huge page settings of the frames in the ring. If
+  // deduplicate_frames is set, frames with the same contents as the previous
+  // frame are dropped before they reach the encoders.
+  explicit EncodingPipeline(
+      std::size_t frame_ring_size = DEFAULT_FRAME_RING_SIZE,
+      std::chrono::milliseconds idle_backoff = DEFAULT_ENCODER_IDLE_BACKOFF,
+      std::shared_ptr<WorkerPool> worker_pool = nullptr,
+      std::size_t stride_alignment = FrameBuffer::DEFAULT_STRIDE_ALIGNMENT,
+      bool use_huge_pages = false, bool deduplicate_frames = false);
 
   void RegisterEncoderFactoryForCodec(Codec codec, EncoderFactory* factory);
 
   bool RegisterClient(Client* client, Codec codec, const CodecOptions& options);
   void DeregisterClient(Client* client);
 
-  // Each line in rgb_data must be aligned to 4 byte
-  void PushFrame(std::size_t width, std::size_t height, const void* rgb_data,
-                 std::size_t size_in_bytes, bool flip_vertically);
+  // Each line in pixel_data must be aligned to 4 byte and the planes of planar
+  // formats must be stored consecutively (see CalculateFrameLayout()).
+  void PushFrame(std::size_t width, std::size_t height, const void* pixel_data,
+                 std::size_t size_in_bytes, bool flip_vertically,
+                 PixelFormat pixel_format = PixelFormat::RGB);
+
+  // Same as above, but only the damaged regions have changed since the
+  // previously pushed frame. pixel_data must still contain the complete frame,
+  // but only the damaged regions (and the regions that changed since the
+  // target frame buffer was written the last time) are copied. The regions
+  // refer to the rows of pixel_data, i.e., they are flipped together with the
+  // frame. The frame is dropped if there are no damaged regions.
+  void PushFrame(std::size_t width, std::size_t height, const void* pixel_data,
+                 std::size_t size_in_bytes,
+                 const std::vector<Rect>& damaged_regions,
+                 bool flip_vertically,
+                 PixelFormat pixel_format = PixelFormat::RGB);
+
+  // Leases the pipeline-owned frame buffer so the caller can render or read
+  // back directly into it. The returned buffer is resized to the requested
+  // dimensions and stays valid until the matching call to CommitFrame(). Other
+  // producers are blocked in between, so every call must be paired with
+  // exactly one call to CommitFrame(). The producer never waits for the
+  // encoders as long as the frame ring is large enough. The contents of the
+  // returned buffer are undefined and the whole frame is considered damaged.
+  FrameBuffer& AcquireWriteFrame(std::size_t width, std::size_t height,
+                                 PixelFormat pixel_format = PixelFormat::RGB);
+  void CommitFrame();
+
+  // Assembles a frame from tiles that are written concurrently, e.g., by the
+  // threads of a sort-last compositing renderer. BeginTiledFrame() leases the
+  // frame buffer like AcquireWriteFrame() and WriteTile() may then be called
+  // from any thread without further synchronization. Each tile is copied
+  // directly into the frame buffer and the frame is committed by the thread
+  // that writes the last of the tile_count tiles. The tiles must not overlap
+  // and should cover the whole frame, the contents of the remaining regions
+  // are undefined. Only packed pixel formats are supported.
+  void BeginTiledFrame(std::size_t width, std::size_t height,
+                       std::size_t tile_count, bool flip_vertically = false,
+                       PixelFormat pixel_format = PixelFormat::RGB);
+
+  // The tile is given in the coordinates of the frame passed to PushFrame(),
+  // i.e., it is flipped together with the frame. If source_stride is 0, each
+  // row of pixel_data is aligned to 4 byte.
+  void WriteTile(const Rect& tile, const void* pixel_data,
+                 std::size_t source_stride = 0);
+
+  // The number of frames that the encoders could not encode in time, see
+  // Encoder::dropped_frame_count().
+  std::uint64_t dropped_frame_count();
+
+  // The number of frames that the encoders skipped to meet their framerate,
+  // see Encoder::decimated_frame_count().
+  std::uint64_t decimated_frame_count();
+
+  // The number of frames that have been dropped because they were identical
+  // to the previous frame.
+  inline std::uint64_t deduplicated_frame_count() const {
+    return deduplicated_frame_count_.load(std::memory_order_relaxed);
+  }
 
  private:
   std::map<Codec, EncoderFactory*> encoder_factories_;
@@ -66,24 +140,50 @@ class WEBSTREAMER_EXPORT EncodingPipeline {
   std::vector<std::thread> encoder_threads_;
   std::mutex encoders_access_mutex_;
 
-  FrameBuffer frame_buffers_[2];
-
+  FrameRing frame_ring_;
+  std::mutex frame_published_mutex_;
+  std::condition_variable frame_published_;
+  std::chrono::milliseconds idle_backoff_;
+  std::shared_ptr<WorkerPool> worker_pool_;
+
+  // Only serializes concurrent producers, the encoders never lock it. A plain
+  // mutex cannot be held until CommitFrame() as tiled frames are committed by
+  // the thread that writes the last tile (see BeginWriting()).
+  std::mutex writing_mutex_;
+  std::condition_variable writing_finished_;
+  bool is_writing_;
   FrameBuffer* writing_frame_buffer_;
-  std::atomic<std::size_t> writing_frame_index_;
-  std::mutex writing_frame_buffer_mutex_;
 
-  FrameBuffer* encoding_frame_buffer_;
-  std::atomic<std::size_t> encoding_frame_index_;
-#if SHARED_MUTEX_SUPPORTED
-  std::shared_timed_mutex encoding_frame_buffer_mutex_;
-#else
-  std::mutex encoding_frame_buffer_mutex_;
-#endif
+  // The tiles of the frame being assembled that have not been written yet
+  std::atomic<std::size_t> remaining_tile_count_;
+  bool is_tiled_frame_flipped_;
+
+  // The damaged regions of the latest published frames of the same size and
+  // format. Used to determine which regions of a reused frame buffer are
+  // outdated. Only accessed by the producer that is writing.
+  std::deque<std::vector<Rect>> damage_history_;
+  std::uint64_t damage_history_last_frame_index_;
+  std::size_t damage_history_width_;
+  std::size_t damage_history_height_;
+  PixelFormat damage_history_pixel_format_;
+
+  // Also only accessed by the producer that is writing
+  bool deduplicate_frames_;
+  std::uint64_t latest_frame_hash_;
+  std::atomic<std::uint64_t> deduplicated_frame_count_;
+
+  void BeginWriting();
+  void EndWriting();
 
-  std::thread swap_thread_;
+  void RecordDamage(const FrameBuffer& frame_buffer);
+  bool CollectDamageSince(std::uint64_t frame_index,
+                          const FrameBuffer& frame_buffer,
+                          std::vector<Rect>* damaged_regions) const;
 
   void EncoderThread(Encoder* encoder);
-  void SwapThread();
+  // The frame in the format the encoder prefers, see Encoder::prefers_i420()
+  const FrameBuffer& GetEncoderInput(const Encoder& encoder,
+                                     const FrameRing::Reference& frame) const;
 };
 
 }  // namespace webstreamer
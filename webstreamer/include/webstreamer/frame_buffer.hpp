@@ -29,61 +29,240 @@
 #include <cstdint>
 #include <memory>
 #include <vector>
+#include "webstreamer/aligned_buffer.hpp"
 #include "webstreamer/export.hpp"
 
 namespace webstreamer {
 
+enum class PixelFormat {
+  // Packed formats
+  RGB,
+  BGR,
+  RGBA,
+  BGRA,
+
+  // Planar formats with 2x2 subsampled chroma
+  I420,  // Y plane, U plane, V plane
+  NV12,  // Y plane, interleaved UV plane
+};
+
+inline std::size_t GetPlaneCount(PixelFormat format) {
+  switch (format) {
+    case PixelFormat::I420:
+      return 3;
+    case PixelFormat::NV12:
+      return 2;
+    default:
+      return 1;
+  }
+}
+
+// For planar formats this returns the size of a luma sample.
+inline std::size_t GetBytesPerPixel(PixelFormat format) {
+  switch (format) {
+    case PixelFormat::RGB:
+    case PixelFormat::BGR:
+      return 3;
+    case PixelFormat::RGBA:
+    case PixelFormat::BGRA:
+      return 4;
+    default:
+      return 1;
+  }
+}
+
+inline bool IsPlanar(PixelFormat format) { return GetPlaneCount(format) > 1; }
+
+const std::size_t MAX_PLANE_COUNT = 3;
+
+struct PlaneLayout {
+  std::size_t offset;
+  std::size_t stride;
+  std::size_t height;
+  std::size_t row_size;  // The number of bytes in a row that contain data
+};
+
+// Calculates the layout of a frame whose planes are stored consecutively and
+// whose rows are aligned to stride_alignment bytes. Returns the total size of
+// the frame in bytes.
+inline std::size_t CalculateFrameLayout(std::size_t width, std::size_t height,
+                                        PixelFormat pixel_format,
+                                        std::size_t stride_alignment,
+                                        PlaneLayout* planes) {
+  assert(stride_alignment > 0);
+  const std::size_t chroma_width = (width + 1) / 2;
+  const std::size_t chroma_height = (height + 1) / 2;
+
+  std::size_t size = 0;
+  auto set_plane = [&](std::size_t plane, std::size_t row_size,
+                       std::size_t plane_height) {
+    planes[plane].offset = size;
+    planes[plane].row_size = row_size;
+    planes[plane].stride =
+        ((row_size + stride_alignment - 1) / stride_alignment) *
+        stride_alignment;
+    planes[plane].height = plane_height;
+    size += planes[plane].stride * plane_height;
+  };
+
+  set_plane(0, GetBytesPerPixel(pixel_format) * width, height);
+  if (pixel_format == PixelFormat::I420) {
+    set_plane(1, chroma_width, chroma_height);
+    set_plane(2, chroma_width, chroma_height);
+  } else if (pixel_format == PixelFormat::NV12) {
+    set_plane(1, 2 * chroma_width, chroma_height);
+  }
+  return size;
+}
+
+// The row alignment of frames passed to PushFrame(), which matches the default
+// GL_PACK_ALIGNMENT.
+const std::size_t PUSH_FRAME_STRIDE_ALIGNMENT = 4;
+
+// A rectangular region of a frame in pixels. The origin is the first row of
+// the frame buffer.
+struct Rect {
+  std::size_t x;
+  std::size_t y;
+  std::size_t width;
+  std::size_t height;
+};
+
 struct FrameInfo {
-  std::chrono::high_resolution_clock::time_point push_timestamp;
+  // The time the producer started to write the frame. The system clock is used
+  // so the timestamp can be compared with the clock of the clients.
+  std::chrono::system_clock::time_point push_timestamp;
+
+  // The index of the frame in the encoding pipeline (see FrameRing).
+  std::uint64_t frame_index = 0;
+
+  // The regions that changed compared to the frame with the index
+  // frame_index - 1. Frames without damage are never published, so this
+  // contains at least one region.
+  std::vector<Rect> damaged_regions;
 };
 
 class WEBSTREAMER_EXPORT FrameBuffer {
  public:
+  static const std::size_t MAX_PLANE_COUNT = webstreamer::MAX_PLANE_COUNT;
+  static const std::size_t DEFAULT_STRIDE_ALIGNMENT = AlignedBuffer::ALIGNMENT;
+
   inline FrameBuffer() : FrameBuffer(0, 0) {}
-  inline FrameBuffer(std::size_t width, std::size_t height)
-      : width_(0), height_(0) {
-    ResizeIfNecessary(width, height);
+  inline FrameBuffer(std::size_t width, std::size_t height,
+                     PixelFormat pixel_format = PixelFormat::RGB,
+                     std::size_t stride_alignment = DEFAULT_STRIDE_ALIGNMENT)
+      : width_(0),
+        height_(0),
+        pixel_format_(PixelFormat::RGB),
+        stride_alignment_(stride_alignment),
+        use_huge_pages_(false) {
+    Resize(width, height, pixel_format);
   }
 
   inline std::size_t width() const { return width_; }
   inline std::size_t height() const { return height_; }
-  inline std::size_t stride() const { return stride_; }
-  inline std::size_t bytes_per_pixel() const { return 3; }
+  inline PixelFormat pixel_format() const { return pixel_format_; }
+  inline std::size_t stride() const { return planes_[0].stride; }
+  inline std::size_t bytes_per_pixel() const {
+    return GetBytesPerPixel(pixel_format_);
+  }
   inline std::size_t size_in_bytes() const { return pixels_.size(); }
 
   inline void* pixel_data() { return pixels_.data(); }
   inline const void* pixel_data() const { return pixels_.data(); }
 
-  inline void* GetRowData(std::size_t row) {
-    assert(row < height_);
-    return pixels_.data() + (row * stride());
-  }
+  inline void* GetRowData(std::size_t row) { return GetPlaneRowData(0, row); }
   inline const void* GetRowData(std::size_t row) const {
-    assert(row < height_);
-    return pixels_.data() + (row * stride());
+    return GetPlaneRowData(0, row);
+  }
+
+  // Planes are stored consecutively in pixel_data(). Packed formats only have
+  // a single plane and plane 0 always refers to the luma plane for planar
+  // formats.
+  inline std::size_t plane_count() const {
+    return GetPlaneCount(pixel_format_);
+  }
+  inline std::size_t GetPlaneStride(std::size_t plane) const {
+    assert(plane < plane_count());
+    return planes_[plane].stride;
+  }
+  inline std::size_t GetPlaneHeight(std::size_t plane) const {
+    assert(plane < plane_count());
+    return planes_[plane].height;
+  }
+  // The number of bytes in a row of the plane that contain actual data.
+  inline std::size_t GetPlaneRowSize(std::size_t plane) const {
+    assert(plane < plane_count());
+    return planes_[plane].row_size;
+  }
+  inline void* GetPlaneData(std::size_t plane) {
+    assert(plane < plane_count());
+    return pixels_.data() + planes_[plane].offset;
+  }
+  inline const void* GetPlaneData(std::size_t plane) const {
+    assert(plane < plane_count());
+    return pixels_.data() + planes_[plane].offset;
+  }
+  inline void* GetPlaneRowData(std::size_t plane, std::size_t row) {
+    assert(row < GetPlaneHeight(plane));
+    return static_cast<std::uint8_t*>(GetPlaneData(plane)) +
+           (row * planes_[plane].stride);
+  }
+  inline const void* GetPlaneRowData(std::size_t plane, std::size_t row) const {
+    assert(row < GetPlaneHeight(plane));
+    return static_cast<const std::uint8_t*>(GetPlaneData(plane)) +
+           (row * planes_[plane].stride);
   }
 
   inline FrameInfo& info() { return info_; }
   inline const FrameInfo& info() const { return info_; }
 
-  inline void ResizeIfNecessary(std::size_t new_width, std::size_t new_height) {
-    if (new_width != width_ || new_height != height_) {
-      width_ = new_width;
-      height_ = new_height;
+  // Rows are aligned to this number of bytes, it must be a power of two. The
+  // pixel data itself is always aligned to AlignedBuffer::ALIGNMENT.
+  inline std::size_t stride_alignment() const { return stride_alignment_; }
+  inline void SetStrideAlignment(std::size_t stride_alignment) {
+    assert(stride_alignment > 0 &&
+           (stride_alignment & (stride_alignment - 1)) == 0);
+    if (stride_alignment != stride_alignment_) {
+      stride_alignment_ = stride_alignment;
+      Resize(width_, height_, pixel_format_);
+    }
+  }
 
-      // Calculate stride
-      const std::size_t bytes_per_line = bytes_per_pixel() * new_width;
-      stride_ = ((bytes_per_line + 3) / 4) * 4;
-      pixels_.resize(stride_ * height_);
+  // Only affects allocations of AlignedBuffer::HUGE_PAGE_SIZE bytes or more.
+  inline bool use_huge_pages() const { return use_huge_pages_; }
+  inline void SetUseHugePages(bool use_huge_pages) {
+    use_huge_pages_ = use_huge_pages;
+  }
+
+  // The contents of the frame are undefined after a resize.
+  inline void ResizeIfNecessary(std::size_t new_width, std::size_t new_height,
+                                PixelFormat new_pixel_format = PixelFormat::RGB) {
+    if (new_width != width_ || new_height != height_ ||
+        new_pixel_format != pixel_format_) {
+      Resize(new_width, new_height, new_pixel_format);
     }
   }
 
  private:
   std::size_t width_;
-  std::size_t stride_;
   std::size_t height_;
-  std::vector<std::uint8_t> pixels_;
+  PixelFormat pixel_format_;
+  std::size_t stride_alignment_;
+  bool use_huge_pages_;
+  PlaneLayout planes_[MAX_PLANE_COUNT];
+  AlignedBuffer pixels_;
   FrameInfo info_;
+
+  inline void Resize(std::size_t new_width, std::size_t new_height,
+                     PixelFormat new_pixel_format) {
+    width_ = new_width;
+    height_ = new_height;
+    pixel_format_ = new_pixel_format;
+    pixels_.Resize(CalculateFrameLayout(new_width, new_height, new_pixel_format,
+                                        stride_alignment_, planes_),
+                   use_huge_pages_);
+  }
 };
 
 }  // namespace webstreamer
@@ -0,0 +1,47 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_FRAME_COPY_HPP_
+#define WEBSTREAMER_INCLUDE_WEBSTREAMER_FRAME_COPY_HPP_
+
+#include <cstddef>
+#include "webstreamer/export.hpp"
+
+namespace webstreamer {
+
+class WorkerPool;
+
+// Copies row_count rows of row_size bytes from source to destination and
+// optionally reverses their order. Large copies use non-temporal stores so the
+// destination does not evict the working set of the calling thread from the
+// cache, and are split into bands of rows that are copied on the worker pool
+// (if one is given).
+WEBSTREAMER_EXPORT void CopyRows(void* destination,
+                                 std::size_t destination_stride,
+                                 const void* source, std::size_t source_stride,
+                                 std::size_t row_size, std::size_t row_count,
+                                 bool flip_vertically,
+                                 WorkerPool* worker_pool = nullptr);
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_INCLUDE_WEBSTREAMER_FRAME_COPY_HPP_
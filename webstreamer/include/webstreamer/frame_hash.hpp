@@ -0,0 +1,45 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_FRAME_HASH_HPP_
+#define WEBSTREAMER_INCLUDE_WEBSTREAMER_FRAME_HASH_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include "webstreamer/export.hpp"
+
+namespace webstreamer {
+
+class FrameBuffer;
+class WorkerPool;
+
+// Calculates a 64 bit hash (based on XXH64) of the pixel data of the frame.
+// The padding at the end of the rows is ignored, but the dimensions and the
+// pixel format are not part of the hash. Large frames are split into bands of
+// rows that are hashed on the worker pool (if one is given). The result does
+// not depend on the worker pool.
+WEBSTREAMER_EXPORT std::uint64_t HashFrame(const FrameBuffer& frame_buffer,
+                                           WorkerPool* worker_pool = nullptr);
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_INCLUDE_WEBSTREAMER_FRAME_HASH_HPP_
@@ -0,0 +1,205 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_FRAME_RING_HPP_
+#define WEBSTREAMER_INCLUDE_WEBSTREAMER_FRAME_RING_HPP_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "webstreamer/export.hpp"
+#include "webstreamer/frame_buffer.hpp"
+
+namespace webstreamer {
+
+class WorkerPool;
+
+// A fixed number of reference-counted frame buffers shared between a single
+// producer and an arbitrary number of consumers. The producer writes into a
+// slot that is neither the latest frame nor pinned by a consumer and publishes
+// it without taking any lock. Consumers pin the latest published frame and
+// keep it alive as long as they hold the returned reference, so a slow
+// consumer never blocks the producer or other consumers. The producer only
+// has to wait if all slots are pinned, i.e., the ring should contain at least
+// two slots more than there are concurrent consumers.
+//
+// Consumers that need the frame at a lower resolution share a resolution
+// pyramid: every registered pyramid level is scaled from the next larger level
+// once per frame, so, e.g., the 480p level is derived from the 720p level
+// instead of from the full resolution frame.
+class WEBSTREAMER_EXPORT FrameRing {
+  typedef std::pair<std::size_t, std::size_t> Size;
+
+  struct Slot {
+    FrameBuffer frame_buffer;
+    std::atomic<std::uint32_t> reference_count{0};
+
+    // The frame converted to I420 (see Reference::GetI420FrameBuffer()). The
+    // conversion is valid if i420_frame_index matches the frame index.
+    std::mutex i420_mutex;
+    FrameBuffer i420_frame_buffer;
+    std::uint64_t i420_frame_index = 0;
+
+    // The levels of the resolution pyramid (see
+    // Reference::GetScaledI420FrameBuffer()) by their size. A level is valid if
+    // the frame index of its info matches the frame index.
+    std::mutex pyramid_mutex;
+    std::map<Size, FrameBuffer> pyramid_levels;
+  };
+
+ public:
+  class WEBSTREAMER_EXPORT Reference {
+    friend class FrameRing;
+
+   public:
+    inline Reference() : ring_(nullptr), slot_(nullptr) {}
+    inline Reference(Reference&& other)
+        : ring_(other.ring_), slot_(other.slot_) {
+      other.slot_ = nullptr;
+    }
+    inline Reference& operator=(Reference&& other) {
+      if (this != &other) {
+        Release();
+        ring_ = other.ring_;
+        slot_ = other.slot_;
+        other.slot_ = nullptr;
+      }
+      return *this;
+    }
+    inline ~Reference() { Release(); }
+
+    Reference(const Reference&) = delete;
+    Reference& operator=(const Reference&) = delete;
+
+    inline explicit operator bool() const { return slot_ != nullptr; }
+
+    inline const FrameBuffer& frame_buffer() const {
+      assert(slot_ != nullptr);
+      return slot_->frame_buffer;
+    }
+    inline std::uint64_t frame_index() const {
+      assert(slot_ != nullptr);
+      return slot_->frame_buffer.info().frame_index;
+    }
+
+    // Returns the frame in I420, packed frames are converted by the first
+    // consumer that calls this and all other consumers of the same frame share
+    // the result. Planar frames are returned as they are. The returned frame
+    // stays valid as long as the reference is held.
+    const FrameBuffer& GetI420FrameBuffer(WorkerPool* worker_pool) const;
+
+    // Returns the frame in I420 scaled to the given size. The registered
+    // pyramid levels between the frame size and the requested size are
+    // computed on the way (see AddPyramidLevel()). Like the I420 conversion,
+    // every level is only computed once per frame and the returned frame stays
+    // valid as long as the reference is held. NV12 frames are returned as they
+    // are, so consumers still have to check the format and size.
+    const FrameBuffer& GetScaledI420FrameBuffer(std::size_t width,
+                                                std::size_t height,
+                                                WorkerPool* worker_pool) const;
+
+   private:
+    const FrameRing* ring_;
+    Slot* slot_;
+
+    inline Reference(const FrameRing* ring, Slot* slot)
+        : ring_(ring), slot_(slot) {}
+
+    const FrameBuffer& UpdatePyramidLevel(const Size& size,
+                                          const FrameBuffer& source,
+                                          WorkerPool* worker_pool) const;
+    inline void Release() {
+      if (slot_ != nullptr) {
+        slot_->reference_count.fetch_sub(1, std::memory_order_release);
+        slot_ = nullptr;
+      }
+    }
+  };
+
+  // The frame buffers of all slots use the given stride alignment and
+  // huge page setting (see FrameBuffer).
+  explicit FrameRing(
+      std::size_t size,
+      std::size_t stride_alignment = FrameBuffer::DEFAULT_STRIDE_ALIGNMENT,
+      bool use_huge_pages = false);
+
+  FrameRing(const FrameRing&) = delete;
+  FrameRing& operator=(const FrameRing&) = delete;
+
+  inline std::size_t size() const { return size_; }
+
+  // Returns the index of the latest published frame. The first published frame
+  // has the index 1, so 0 means that no frame has been published yet.
+  inline std::uint64_t latest_frame_index() const {
+    return latest_frame_index_.load(std::memory_order_acquire);
+  }
+
+  // Producer interface. Only one thread may write at a time and every call to
+  // BeginWrite() must be followed by exactly one call to Publish(). The frame
+  // returned by BeginWrite() still contains the previous contents of the slot,
+  // i.e., its frame index refers to the frame that is overwritten. Publish()
+  // sets the frame index of the new frame.
+  FrameBuffer& BeginWrite();
+  std::uint64_t Publish();
+  // Gives the slot back without publishing it. The slot keeps its previous
+  // frame index, so its contents must not differ from that frame in any way
+  // that matters to the producer.
+  void CancelWrite();
+
+  // Consumer interface. Pins the latest published frame. The returned
+  // reference is empty if no frame has been published yet.
+  Reference AcquireLatest();
+
+  // Registers a level of the resolution pyramid. Levels are never removed, so
+  // this is typically called once for every encoder that consumes scaled
+  // frames.
+  void AddPyramidLevel(std::size_t width, std::size_t height);
+
+ private:
+  static const std::uint32_t WRITING = 0xffffffff;
+  static const std::size_t NO_SLOT = static_cast<std::size_t>(-1);
+
+  std::size_t size_;
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<std::size_t> latest_slot_;
+  std::atomic<std::uint64_t> latest_frame_index_;
+
+  // Only accessed by the producer
+  std::size_t writing_slot_;
+  std::uint64_t writing_frame_index_;
+
+  // Sorted by descending area
+  mutable std::mutex pyramid_levels_mutex_;
+  std::vector<Size> pyramid_levels_;
+
+  std::vector<Size> GetPyramidLevels() const;
+};
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_INCLUDE_WEBSTREAMER_FRAME_RING_HPP_
@@ -0,0 +1,45 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_FRAME_SCALING_HPP_
+#define WEBSTREAMER_INCLUDE_WEBSTREAMER_FRAME_SCALING_HPP_
+
+#include "webstreamer/export.hpp"
+#include "webstreamer/frame_buffer.hpp"
+
+namespace webstreamer {
+
+class WorkerPool;
+
+// Scales an I420 frame to the size of the destination frame, which must be an
+// I420 frame as well. Each destination pixel is the average of the source
+// pixels it covers (area filter), so downscaling by large factors does not
+// alias. Upscaling degrades to nearest neighbour filtering. Large frames are
+// split into slices of rows that are scaled on the worker pool (if one is
+// given).
+WEBSTREAMER_EXPORT void ScaleI420(const FrameBuffer& source,
+                                  FrameBuffer* destination,
+                                  WorkerPool* worker_pool = nullptr);
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_INCLUDE_WEBSTREAMER_FRAME_SCALING_HPP_
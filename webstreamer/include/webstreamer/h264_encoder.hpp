@@ -25,6 +25,8 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <map>
+#include <mutex>
 #include <vector>
 #include "webstreamer/suppress_warnings.hpp"
 SUPPRESS_WARNINGS_BEGIN
@@ -41,26 +43,102 @@ SUPPRESS_WARNINGS_END
 
 namespace webstreamer {
 
+// With the in-tree converter (see ConvertToI420()), packed frames are
+// converted to I420 and scaled to the display mode once by the encoding
+// pipeline and shared with all other H.264 encoders (see
+// FrameRing::GetScaledI420FrameBuffer()). With swscale, every encoder converts
+// and scales packed frames on its own.
+enum class ColorConverter {
+  BUILTIN,
+  SWSCALE,
+};
+
+// Trades cores for latency, see the x264 parameters of the same name. More
+// threads without sliced threads add one frame of latency per thread, sliced
+// threads split every frame into slices instead. The lookahead delays the
+// output by as many frames.
+struct H264ThreadingOptions {
+  int thread_count = 1;
+  bool sliced_threads = true;
+  int slice_count = 0;  // 0 lets x264 choose
+  int lookahead = 0;
+  // Sends every slice to the clients as soon as it is encoded instead of
+  // waiting for the whole frame. Requires sliced threads or a single thread.
+  bool stream_slices = false;
+};
+
+// ABR and CRF may spend a multiple of the average bitrate on single frames
+// (e.g., keyframes) unless the VBV limits the rate. CBR always limits the rate
+// to the bitrate.
+enum class H264RateControl {
+  ABR,
+  CBR,
+  CRF,
+};
+
+struct H264RateControlOptions {
+  H264RateControl method = H264RateControl::ABR;
+  float crf = 23.0f;
+  // In kbit/s and kbit, 0 disables the VBV for ABR and CRF. Without a buffer
+  // size, the buffer holds one frame at the maximum rate, which keeps the
+  // latency low.
+  int vbv_max_bitrate = 0;
+  int vbv_buffer_size = 0;
+  // Spreads the intra coded macroblocks over the frames of every refresh
+  // period instead of sending keyframes, which keeps the frame sizes flat.
+  // Clients that join wait for the next refresh wave instead of forcing a
+  // keyframe. The period is given in frames, 0 uses one second.
+  bool intra_refresh = false;
+  int intra_refresh_period = 0;
+};
+
 class WEBSTREAMER_EXPORT H264Encoder : public Encoder {
  public:
-  H264Encoder(int width, int height, int framerate, int bitrate);
+  H264Encoder(int width, int height, int framerate, int bitrate,
+              ColorConverter color_converter = ColorConverter::BUILTIN,
+              const H264ThreadingOptions& threading_options =
+                  H264ThreadingOptions(),
+              const H264RateControlOptions& rate_control_options =
+                  H264RateControlOptions());
   ~H264Encoder() override;
 
   bool IsCompatible(const CodecOptions& configuration) override;
+  int framerate() const override { return framerate_; }
+  // Frame threads and the lookahead delay the output of x264
+  bool has_delayed_frames() override;
+  bool prefers_i420() const override {
+    return color_converter_ == ColorConverter::BUILTIN;
+  }
+  std::size_t preferred_input_width() const override {
+    return prefers_i420() ? static_cast<std::size_t>(output_width_) : 0;
+  }
+  std::size_t preferred_input_height() const override {
+    return prefers_i420() ? static_cast<std::size_t>(output_height_) : 0;
+  }
 
  protected:
-  EncodedFrame EncodeFrame(const FrameBuffer& frame_buffer) override;
+  EncodedFrame EncodeFrame(
+      const FrameBuffer& frame_buffer,
+      std::vector<std::uint8_t>* serialized_frame) override;
 
  private:
   void Reset();
+  void ApplyRateControlOptions();
+  // Appends the NAL units returned by x264 for encoder_output_picture_
+  EncodedFrame AppendNals(const x264_nal_t* nals, int nal_count,
+                          std::vector<std::uint8_t>* serialized_frame);
 
   int input_width_;
   int input_height_;
+  PixelFormat input_pixel_format_;
 
   int output_width_;
   int output_height_;
   int framerate_;
   int bitrate_;
+  ColorConverter color_converter_;
+  H264ThreadingOptions threading_options_;
+  H264RateControlOptions rate_control_options_;
 
   bool needs_reset_;
 
@@ -68,9 +146,45 @@ class WEBSTREAMER_EXPORT H264Encoder : public Encoder {
   x264_t* encoder_;
   x264_picture_t encoder_input_picture_;
   x264_picture_t encoder_output_picture_;
-  SwsContext* sws_context_;
-
-  std::vector<std::uint8_t> buffer_;
+  // Refers directly to the planes of YUV input frames that do not need to be
+  // scaled, x264 copies the data during x264_encoder_encode().
+  x264_picture_t passthrough_picture_;
+  // x264 requires strictly increasing timestamps, but frames repeated by
+  // Encoder::Flush() share their frame index. So every input picture gets the
+  // next timestamp, which maps to the frame index until x264 returns it.
+  std::int64_t next_timestamp_;
+  std::map<std::int64_t, std::uint64_t> frame_indices_;
+
+  // The frames are scaled in horizontal slices on the worker pool, each slice
+  // has its own context.
+  struct ScalingSlice {
+    SwsContext* sws_context;
+    int first_input_row;
+    int input_row_count;
+    int first_output_row;
+    int output_row_count;
+  };
+  std::vector<ScalingSlice> scaling_slices_;
+
+  void ResetScalingSlices();
+  void ScaleSlice(const FrameBuffer& frame_buffer, std::size_t slice);
+
+  // With stream_slices, every NAL unit is sent as soon as x264 has written it.
+  // Slices may be finished out of order, so each slice is held back until all
+  // previous macroblocks of the frame have been sent.
+  struct PendingSlice {
+    int last_macroblock;
+    std::vector<std::uint8_t> data;
+  };
+  std::mutex streaming_mutex_;
+  std::map<int, PendingSlice> pending_slices_;
+  int next_macroblock_ = 0;
+  int macroblock_count_ = 0;
+  bool is_streaming_keyframe_ = false;
+
+  static void ProcessNal(x264_t* encoder, x264_nal_t* nal, void* opaque);
+  void SendNal(const x264_nal_t& nal, std::vector<std::uint8_t> data);
+  void SendPendingSlices(bool flush);
 };
 
 }  // namespace webstreamer
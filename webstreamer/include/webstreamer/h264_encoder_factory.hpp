@@ -23,6 +23,7 @@
 #ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_H264_ENCODER_FACTORY_HPP_
 #define WEBSTREAMER_INCLUDE_WEBSTREAMER_H264_ENCODER_FACTORY_HPP_
 
+#include <string>
 #include "webstreamer/encoder_factory.hpp"
 #include "webstreamer/suppress_warnings.hpp"
 SUPPRESS_WARNINGS_BEGIN
@@ -42,6 +43,23 @@ class WEBSTREAMER_EXPORT H264EncoderFactory : public EncoderFactory {
  private:
   const Poco::Util::JSONConfiguration* configuration_;
   Poco::Util::JSONConfiguration* stream_config_;
+  int display_mode_count_;
+
+  // Returns the configuration key of the display mode that matches the size
+  // and framerate of the options or an empty string if there is none.
+  std::string FindDisplayMode(const Poco::JSON::Object& options) const;
+
+  // Settings of the display mode override the settings of the codec, which
+  // override the given default.
+  int GetIntSetting(const std::string& display_mode, const std::string& name,
+                    int default_value) const;
+  bool GetBoolSetting(const std::string& display_mode, const std::string& name,
+                      bool default_value) const;
+  double GetDoubleSetting(const std::string& display_mode,
+                          const std::string& name, double default_value) const;
+  std::string GetStringSetting(const std::string& display_mode,
+                               const std::string& name,
+                               const std::string& default_value) const;
 };
 
 }  // namespace webstreamer
@@ -0,0 +1,62 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_H264_NAL_UNITS_HPP_
+#define WEBSTREAMER_INCLUDE_WEBSTREAMER_H264_NAL_UNITS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "webstreamer/export.hpp"
+
+namespace webstreamer {
+
+// nal_unit_type values (ITU-T H.264, table 7-1) used by the encoder
+const std::uint8_t H264_NAL_SLICE = 1;
+const std::uint8_t H264_NAL_SLICE_IDR = 5;
+const std::uint8_t H264_NAL_SEI = 6;
+const std::uint8_t H264_NAL_SPS = 7;
+const std::uint8_t H264_NAL_PPS = 8;
+
+struct H264NalUnit {
+  // nal_ref_idc, 0 if no other picture refers to the NAL unit
+  std::uint8_t ref_idc;
+  std::uint8_t type;
+  // The NAL unit without its start code, including the header byte
+  const std::uint8_t* data;
+  std::size_t size_in_bytes;
+};
+
+// Splits an Annex B byte stream at its start codes. Data in front of the first
+// start code is ignored.
+WEBSTREAMER_EXPORT std::vector<H264NalUnit> ParseH264NalUnits(
+    const std::uint8_t* data, std::size_t size_in_bytes);
+
+// Whether the byte stream contains slices that no other frame refers to only,
+// i.e., whether the frame can be dropped without corrupting the following
+// frames. Returns false for data without slices (e.g., parameter sets).
+WEBSTREAMER_EXPORT bool IsH264NonReferenceFrame(const std::uint8_t* data,
+                                                std::size_t size_in_bytes);
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_INCLUDE_WEBSTREAMER_H264_NAL_UNITS_HPP_
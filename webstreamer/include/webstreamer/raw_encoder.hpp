@@ -23,19 +23,35 @@
 #ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_RAW_ENCODER_HPP_
 #define WEBSTREAMER_INCLUDE_WEBSTREAMER_RAW_ENCODER_HPP_
 
+#include "webstreamer/suppress_warnings.hpp"
+SUPPRESS_WARNINGS_BEGIN
+extern "C" {
+#include "libswscale/swscale.h"
+}
+SUPPRESS_WARNINGS_END
 #include "webstreamer/encoder.hpp"
 #include "webstreamer/export.hpp"
+#include "webstreamer/frame_buffer.hpp"
 
 namespace webstreamer {
 
 class WEBSTREAMER_EXPORT RawEncoder : public Encoder {
  public:
+  RawEncoder();
+  ~RawEncoder() override;
+
   bool IsCompatible(const CodecOptions& configuration) override;
 
  protected:
-  EncodedFrame EncodeFrame(const FrameBuffer& frame_buffer) override;
+  EncodedFrame EncodeFrame(
+      const FrameBuffer& frame_buffer,
+      std::vector<std::uint8_t>* serialized_frame) override;
 
  private:
+  // Frames that are not pushed as RGB are converted before sending them to
+  // the clients.
+  SwsContext* sws_context_;
+  FrameBuffer rgb_frame_buffer_;
 };
 
 }  // namespace webstreamer
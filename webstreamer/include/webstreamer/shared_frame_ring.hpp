@@ -0,0 +1,157 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_SHARED_FRAME_RING_HPP_
+#define WEBSTREAMER_INCLUDE_WEBSTREAMER_SHARED_FRAME_RING_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// The layout of the shared memory segment that is used to pass frames from a
+// SharedMemoryProducer (webstreamer-producer library) to a SharedMemoryIngest
+// running in another process. The producer creates the segment, so either side
+// can be restarted without affecting the other one. This header must not
+// depend on anything but the standard library and the operating system.
+//
+// The protocol follows FrameRing: the producer writes into a slot that is
+// neither the latest one nor pinned by the consumer, publishes it by storing
+// its index in latest_slot and increments the sequence, which doubles as the
+// futex word the consumer sleeps on.
+
+namespace webstreamer {
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2,
+              "Atomics in shared memory must be lock-free");
+
+const std::uint32_t SHARED_FRAME_RING_MAGIC = 0x52465357;  // "WSFR"
+const std::uint32_t SHARED_FRAME_RING_VERSION = 1;
+const std::uint32_t SHARED_FRAME_RING_NO_SLOT = 0xffffffff;
+const std::uint32_t SHARED_FRAME_RING_WRITING = 0xffffffff;
+const std::size_t SHARED_FRAME_RING_ALIGNMENT = 64;
+
+struct SharedFrameSlot {
+  std::atomic<std::uint32_t> reference_count;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t pixel_format;  // webstreamer::PixelFormat
+  std::uint32_t flip_vertically;
+  std::uint32_t reserved;
+  std::uint64_t size_in_bytes;
+  // Relative to the beginning of the segment
+  std::uint64_t data_offset;
+};
+
+struct SharedFrameRingHeader {
+  // Written last by the producer, the segment must not be used before it
+  // contains SHARED_FRAME_RING_MAGIC.
+  std::atomic<std::uint32_t> magic;
+  std::uint32_t version;
+  std::uint32_t slot_count;
+  std::uint32_t reserved;
+  std::uint64_t slot_capacity;
+
+  std::atomic<std::uint32_t> latest_slot;
+  std::atomic<std::uint32_t> sequence;
+  std::atomic<std::uint32_t> consumer_waiting;
+};
+
+inline std::size_t AlignSharedFrameRingOffset(std::size_t offset) {
+  return (offset + SHARED_FRAME_RING_ALIGNMENT - 1) /
+         SHARED_FRAME_RING_ALIGNMENT * SHARED_FRAME_RING_ALIGNMENT;
+}
+
+inline SharedFrameSlot* GetSharedFrameSlots(SharedFrameRingHeader* header) {
+  return reinterpret_cast<SharedFrameSlot*>(
+      reinterpret_cast<std::uint8_t*>(header) +
+      AlignSharedFrameRingOffset(sizeof(SharedFrameRingHeader)));
+}
+
+inline std::size_t GetSharedFrameDataOffset(std::size_t slot_count,
+                                            std::size_t slot_capacity,
+                                            std::size_t slot) {
+  return AlignSharedFrameRingOffset(
+             AlignSharedFrameRingOffset(sizeof(SharedFrameRingHeader)) +
+             slot_count * sizeof(SharedFrameSlot)) +
+         slot * AlignSharedFrameRingOffset(slot_capacity);
+}
+
+inline std::size_t GetSharedFrameRingSize(std::size_t slot_count,
+                                          std::size_t slot_capacity) {
+  return GetSharedFrameDataOffset(slot_count, slot_capacity, slot_count);
+}
+
+// Clears the pins a consumer that died while ingesting a frame left behind.
+// There is only one consumer, so it calls this when it attaches. Slots that
+// the producer is writing into are not touched.
+inline void ReleaseSharedFrameRingPins(SharedFrameRingHeader* header) {
+  SharedFrameSlot* const slots = GetSharedFrameSlots(header);
+  for (std::uint32_t i = 0; i < header->slot_count; ++i) {
+    std::uint32_t reference_count =
+        slots[i].reference_count.load(std::memory_order_relaxed);
+    while (reference_count != 0 &&
+           reference_count != SHARED_FRAME_RING_WRITING &&
+           !slots[i].reference_count.compare_exchange_weak(
+               reference_count, 0, std::memory_order_relaxed)) {
+    }
+  }
+}
+
+// shm_open() expects names that start with a slash
+inline std::string GetSharedFrameRingPath(const std::string& name) {
+  return !name.empty() && name[0] == '/' ? name : '/' + name;
+}
+
+#if defined(__linux__)
+// The futex is shared between processes, so FUTEX_PRIVATE_FLAG must not be
+// used. Returns false on timeouts.
+inline bool WaitForSharedFrameRingSequence(
+    std::atomic<std::uint32_t>* sequence, std::uint32_t expected_value,
+    std::chrono::milliseconds timeout) {
+  struct timespec relative_timeout;
+  relative_timeout.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+  relative_timeout.tv_nsec =
+      static_cast<long>(timeout.count() % 1000 * 1000000);  // NOLINT
+  return syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(sequence),
+                 FUTEX_WAIT, expected_value, &relative_timeout, nullptr,
+                 0) == 0;
+}
+
+inline void WakeSharedFrameRingConsumer(
+    std::atomic<std::uint32_t>* sequence) {
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(sequence), FUTEX_WAKE,
+          1, nullptr, nullptr, 0);
+}
+#endif
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_INCLUDE_WEBSTREAMER_SHARED_FRAME_RING_HPP_
@@ -0,0 +1,81 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_SHARED_MEMORY_INGEST_HPP_
+#define WEBSTREAMER_INCLUDE_WEBSTREAMER_SHARED_MEMORY_INGEST_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include "webstreamer/export.hpp"
+#include "webstreamer/shared_frame_ring.hpp"
+
+namespace webstreamer {
+
+class EncodingPipeline;
+
+const std::chrono::milliseconds DEFAULT_SHARED_MEMORY_INGEST_BACKOFF(100);
+
+// Receives the frames of a SharedMemoryProducer in another process and pushes
+// them into an encoding pipeline, i.e., the frames are handled exactly like
+// frames passed to EncodingPipeline::PushFrame(). The ingest thread sleeps
+// until the producer publishes a frame but wakes up at least once per
+// idle_backoff to check whether the producer has been restarted. It waits for
+// the producer to create the shared memory segment if it does not exist yet.
+// Only available on Linux.
+class WEBSTREAMER_EXPORT SharedMemoryIngest {
+ public:
+  SharedMemoryIngest(
+      const std::string& name, EncodingPipeline* encoding_pipeline,
+      std::chrono::milliseconds idle_backoff =
+          DEFAULT_SHARED_MEMORY_INGEST_BACKOFF);
+  ~SharedMemoryIngest();
+
+  SharedMemoryIngest(const SharedMemoryIngest&) = delete;
+  SharedMemoryIngest& operator=(const SharedMemoryIngest&) = delete;
+
+ private:
+  std::string path_;
+  EncodingPipeline* encoding_pipeline_;
+  std::chrono::milliseconds idle_backoff_;
+
+  SharedFrameRingHeader* header_;
+  std::size_t mapping_size_;
+  std::uint64_t mapped_inode_;
+  std::uint32_t last_sequence_;
+
+  std::atomic<bool> stop_;
+  std::thread ingest_thread_;
+
+  bool Attach();
+  void Detach();
+  bool HasProducerRestarted() const;
+  void IngestLatestFrame();
+  void IngestThread();
+};
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_INCLUDE_WEBSTREAMER_SHARED_MEMORY_INGEST_HPP_
@@ -85,6 +85,7 @@ class WEBSTREAMER_EXPORT WebRTCStreamClient
   // From webrtc::DataChannelObserver
   void OnStateChange() override;
   void OnMessage(const webrtc::DataBuffer& buffer) override;
+  void OnBufferedAmountChange(uint64_t previous_amount) override;
 
   // From rtc::RefCountInterface
   // TODO(Simon): This is somewhat hacky? check with the documentation of
@@ -51,6 +51,8 @@ class WEBSTREAMER_EXPORT WebSocketStreamClient : public Client {
   void SendEvent(const Event& event) override;
 
  private:
+  // Serializes the messages, the buffer is only used for messages that are not
+  // serialized already.
   std::mutex buffer_mutex_;
   std::vector<std::uint8_t> buffer_;
   Poco::Net::WebSocket web_socket_;
@@ -58,6 +60,8 @@ class WEBSTREAMER_EXPORT WebSocketStreamClient : public Client {
   std::thread receive_thread_;
 
   void SendData(DataType data_type, const void* data, std::size_t data_size);
+  // Sends a complete message, buffer_mutex_ must be locked.
+  void SendBytes(const void* data, std::size_t size);
   void ReceiveThread();
 };
 
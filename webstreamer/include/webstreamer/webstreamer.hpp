@@ -23,7 +23,12 @@
 #ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_WEBSTREAMER_HPP_
 #define WEBSTREAMER_INCLUDE_WEBSTREAMER_WEBSTREAMER_HPP_
 
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <webstreamer/client_set.hpp>
 #include <webstreamer/encoding_pipeline.hpp>
 #include <webstreamer/input_processor.hpp>
@@ -34,6 +39,7 @@ SUPPRESS_WARNINGS_BEGIN
 SUPPRESS_WARNINGS_END
 #include "webstreamer/h264_encoder_factory.hpp"
 #include "webstreamer/raw_encoder_factory.hpp"
+#include "webstreamer/shared_memory_ingest.hpp"
 #include "webstreamer/web_server.hpp"
 #include "webstreamer/webrtc_stream_server.hpp"
 #include "webstreamer/websocket_stream_server.hpp"
@@ -66,16 +72,97 @@ class WEBSTREAMER_EXPORT WebStreamer final {
     return current_input_processor_;
   }
 
-  // Each line in rgb_data must be aligned to 4 byte
-  void PushFrame(std::size_t width, std::size_t height, const void* rgb_data,
-                 std::size_t size_in_bytes, bool flip_vertically = false);
+  // Each line in pixel_data must be aligned to 4 byte. See
+  // EncodingPipeline::PushFrame() for the layout of planar formats.
+  void PushFrame(std::size_t width, std::size_t height, const void* pixel_data,
+                 std::size_t size_in_bytes, bool flip_vertically = false,
+                 PixelFormat pixel_format = PixelFormat::RGB);
+
+  // Only copies the regions of the frame that changed since the previous call
+  // and drops the frame if damaged_regions is empty. See
+  // EncodingPipeline::PushFrame() for details.
+  void PushFrame(std::size_t width, std::size_t height, const void* pixel_data,
+                 std::size_t size_in_bytes,
+                 const std::vector<Rect>& damaged_regions,
+                 bool flip_vertically = false,
+                 PixelFormat pixel_format = PixelFormat::RGB);
+
+  // Zero-copy alternative to PushFrame(): write the frame directly into the
+  // returned buffer and call CommitFrame() afterwards. See
+  // EncodingPipeline::AcquireWriteFrame() for details.
+  FrameBuffer& AcquireWriteFrame(std::size_t width, std::size_t height,
+                                 PixelFormat pixel_format = PixelFormat::RGB);
+  void CommitFrame();
+
+  // Assembles a frame from tiles that are written concurrently by multiple
+  // threads. The frame is published as soon as the last tile has been written.
+  // See EncodingPipeline::BeginTiledFrame() for details.
+  void BeginTiledFrame(std::size_t width, std::size_t height,
+                       std::size_t tile_count, bool flip_vertically = false,
+                       PixelFormat pixel_format = PixelFormat::RGB);
+  void WriteTile(const Rect& tile, const void* pixel_data,
+                 std::size_t source_stride = 0);
+
+  // The functions above feed the default source. Applications that stream
+  // multiple images can push them to named sources instead. Every source has
+  // its own encoding pipeline that is created on first use, while the servers,
+  // the clients and the worker threads are shared. Clients select a source via
+  // the "source" codec option (see ClientSet). The empty id refers to the
+  // default source.
+  void PushFrame(const std::string& source_id, std::size_t width,
+                 std::size_t height, const void* pixel_data,
+                 std::size_t size_in_bytes, bool flip_vertically = false,
+                 PixelFormat pixel_format = PixelFormat::RGB);
+  void PushFrame(const std::string& source_id, std::size_t width,
+                 std::size_t height, const void* pixel_data,
+                 std::size_t size_in_bytes,
+                 const std::vector<Rect>& damaged_regions,
+                 bool flip_vertically = false,
+                 PixelFormat pixel_format = PixelFormat::RGB);
+  FrameBuffer& AcquireWriteFrame(const std::string& source_id,
+                                 std::size_t width, std::size_t height,
+                                 PixelFormat pixel_format = PixelFormat::RGB);
+  void CommitFrame(const std::string& source_id);
+  void BeginTiledFrame(const std::string& source_id, std::size_t width,
+                       std::size_t height, std::size_t tile_count,
+                       bool flip_vertically = false,
+                       PixelFormat pixel_format = PixelFormat::RGB);
+  void WriteTile(const std::string& source_id, const Rect& tile,
+                 const void* pixel_data, std::size_t source_stride = 0);
+
+  // Receives frames from a SharedMemoryProducer with the given name running in
+  // another process and pushes them into the given source. The producer may
+  // be started before or after this call and may be restarted at any time. The
+  // "ingest.sharedMemory" and "ingest.source" options start an ingest on
+  // construction. Only available on Linux.
+  void StartSharedMemoryIngest(const std::string& name,
+                               const std::string& source_id = "");
+
+  // Summed up over all sources, see EncodingPipeline::dropped_frame_count()
+  std::uint64_t dropped_frame_count();
+
+  // Summed up over all sources, see
+  // EncodingPipeline::decimated_frame_count()
+  std::uint64_t decimated_frame_count();
+
+  // Summed up over all sources, see
+  // EncodingPipeline::deduplicated_frame_count()
+  std::uint64_t deduplicated_frame_count();
+
+  // Summed up over all clients, see ClientSet::dropped_frame_count() and
+  // ClientSet::requested_keyframe_count()
+  std::uint64_t client_dropped_frame_count();
+  std::uint64_t requested_keyframe_count();
 
  private:
   Poco::Util::JSONConfiguration configuration_;
   Poco::Util::JSONConfiguration stream_config_;
   WebServer web_server_;
   InputProcessor* current_input_processor_;
-  EncodingPipeline encoding_pipeline_;
+  std::shared_ptr<WorkerPool> worker_pool_;
+  std::unique_ptr<EncodingPipeline> encoding_pipeline_;
+  std::mutex sources_mutex_;
+  std::map<std::string, std::unique_ptr<EncodingPipeline>> sources_;
   ClientSet clients_;
 
   // Streams
@@ -87,6 +174,13 @@ class WEBSTREAMER_EXPORT WebStreamer final {
   // Codecs
   RawEncoderFactory raw_encoder_factory_;
   H264EncoderFactory h264_encoder_factory_;
+
+  // Must be destroyed first as they push frames into the sources
+  std::mutex shared_memory_ingests_mutex_;
+  std::vector<std::unique_ptr<SharedMemoryIngest>> shared_memory_ingests_;
+
+  std::unique_ptr<EncodingPipeline> CreateEncodingPipeline();
+  EncodingPipeline* GetSource(const std::string& source_id);
 };
 
 }  // namespace webstreamer
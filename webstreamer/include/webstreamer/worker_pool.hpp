@@ -0,0 +1,78 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_INCLUDE_WEBSTREAMER_WORKER_POOL_HPP_
+#define WEBSTREAMER_INCLUDE_WEBSTREAMER_WORKER_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "webstreamer/export.hpp"
+
+namespace webstreamer {
+
+// A fixed set of threads that execute the iterations of parallel loops. The
+// calling thread participates in the loop, so a pool without any threads just
+// runs the loop sequentially. Multiple threads may call ParallelFor()
+// concurrently.
+class WEBSTREAMER_EXPORT WorkerPool {
+ public:
+  explicit WorkerPool(std::size_t thread_count);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  inline std::size_t thread_count() const { return threads_.size(); }
+
+  // Calls function(i) for every i in [0, count) and returns after all calls
+  // have finished.
+  void ParallelFor(std::size_t count,
+                   const std::function<void(std::size_t)>& function);
+
+ private:
+  struct Job {
+    const std::function<void(std::size_t)>* function;
+    std::size_t count;
+    std::atomic<std::size_t> next_index;
+    std::size_t worker_count;  // Protected by mutex_
+  };
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable job_available_;
+  std::condition_variable job_finished_;
+  std::deque<Job*> jobs_;
+  bool stop_ = false;
+
+  void WorkerThread();
+  static void RunJob(Job* job);
+};
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_INCLUDE_WEBSTREAMER_WORKER_POOL_HPP_
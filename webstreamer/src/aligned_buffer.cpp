@@ -0,0 +1,135 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "webstreamer/aligned_buffer.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#include "log.hpp"
+
+#if defined(_WIN32)
+#include <malloc.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace webstreamer {
+
+namespace {
+
+std::uint8_t* AllocateAligned(std::size_t size, std::size_t alignment) {
+#if defined(_WIN32)
+  void* memory = _aligned_malloc(size, alignment);
+#else
+  void* memory = nullptr;
+  if (posix_memalign(&memory, alignment, size) != 0) {
+    memory = nullptr;
+  }
+#endif
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return static_cast<std::uint8_t*>(memory);
+}
+
+void FreeAligned(std::uint8_t* memory) {
+#if defined(_WIN32)
+  _aligned_free(memory);
+#else
+  std::free(memory);
+#endif
+}
+
+}  // namespace
+
+const std::size_t AlignedBuffer::ALIGNMENT;
+const std::size_t AlignedBuffer::HUGE_PAGE_SIZE;
+
+AlignedBuffer::AlignedBuffer(const AlignedBuffer& other) : AlignedBuffer() {
+  *this = other;
+}
+
+AlignedBuffer::AlignedBuffer(AlignedBuffer&& other)
+    : data_(other.data_), size_(other.size_), capacity_(other.capacity_) {
+  other.data_ = nullptr;
+  other.size_ = 0;
+  other.capacity_ = 0;
+}
+
+AlignedBuffer::~AlignedBuffer() { Free(); }
+
+AlignedBuffer& AlignedBuffer::operator=(const AlignedBuffer& other) {
+  if (this != &other) {
+    Resize(other.size_);
+    if (size_ > 0) {
+      std::memcpy(data_, other.data_, size_);
+    }
+  }
+  return *this;
+}
+
+AlignedBuffer& AlignedBuffer::operator=(AlignedBuffer&& other) {
+  if (this != &other) {
+    Free();
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+  }
+  return *this;
+}
+
+void AlignedBuffer::Resize(std::size_t size, bool use_huge_pages) {
+  if (size <= capacity_) {
+    size_ = size;
+    return;
+  }
+
+  Free();
+
+  if (use_huge_pages && size >= HUGE_PAGE_SIZE) {
+    // Round up to whole huge pages, so the kernel can back the entire buffer
+    // with them.
+    capacity_ = ((size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+    data_ = AllocateAligned(capacity_, HUGE_PAGE_SIZE);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (madvise(data_, capacity_, MADV_HUGEPAGE) != 0) {
+      LOGD("madvise(MADV_HUGEPAGE) failed for ", capacity_, " bytes");
+    }
+#endif
+  } else {
+    capacity_ = ((size + ALIGNMENT - 1) / ALIGNMENT) * ALIGNMENT;
+    data_ = AllocateAligned(capacity_, ALIGNMENT);
+  }
+  size_ = size;
+}
+
+void AlignedBuffer::Free() {
+  if (data_ != nullptr) {
+    FreeAligned(data_);
+    data_ = nullptr;
+  }
+  size_ = 0;
+  capacity_ = 0;
+}
+
+}  // namespace webstreamer
@@ -0,0 +1,56 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#ifndef WEBSTREAMER_SRC_AV_PIXEL_FORMAT_HPP_
+#define WEBSTREAMER_SRC_AV_PIXEL_FORMAT_HPP_
+
+#include "webstreamer/frame_buffer.hpp"
+#include "webstreamer/suppress_warnings.hpp"
+SUPPRESS_WARNINGS_BEGIN
+extern "C" {
+#include "libswscale/swscale.h"
+}
+SUPPRESS_WARNINGS_END
+
+namespace webstreamer {
+
+inline AVPixelFormat GetAVPixelFormat(PixelFormat pixel_format) {
+  switch (pixel_format) {
+    case PixelFormat::RGB:
+      return AV_PIX_FMT_RGB24;
+    case PixelFormat::BGR:
+      return AV_PIX_FMT_BGR24;
+    case PixelFormat::RGBA:
+      return AV_PIX_FMT_RGBA;
+    case PixelFormat::BGRA:
+      return AV_PIX_FMT_BGRA;
+    case PixelFormat::I420:
+      return AV_PIX_FMT_YUV420P;
+    case PixelFormat::NV12:
+      return AV_PIX_FMT_NV12;
+  }
+  return AV_PIX_FMT_NONE;
+}
+
+}  // namespace webstreamer
+
+#endif  // WEBSTREAMER_SRC_AV_PIXEL_FORMAT_HPP_
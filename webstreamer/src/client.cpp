@@ -20,16 +20,99 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //------------------------------------------------------------------------------
 
+#include <algorithm>
 #include <cassert>
 #include <webstreamer/client.hpp>
+#include <webstreamer/client_set.hpp>
 #include <webstreamer/encoding_pipeline.hpp>
+#include "log.hpp"
 
 namespace webstreamer {
 
-void Client::PushFrame(const EncodedFrame& encoded_frame) {
-  if (is_active()) {
-    OnFrameEncoded(encoded_frame);
+Client::Client() {}
+
+Client::~Client() { StopSending(); }
+
+bool Client::PushFrame(const EncodedFrame& encoded_frame) {
+  if (!is_active()) {
+    return true;
+  }
+
+  const bool is_frame_start = encoded_frame.part_index == 0;
+  const bool is_keyframe_start = encoded_frame.is_keyframe && is_frame_start;
+  const std::size_t size_in_bytes = encoded_frame.serialized_frame->size();
+  {
+    std::lock_guard<std::mutex> lock(send_queue_mutex_);
+    if (is_sending_stopped_) {
+      return true;
+    }
+    if (is_dropping_frame_) {
+      if (!is_frame_start &&
+          encoded_frame.frame_index == dropping_frame_index_) {
+        return true;
+      }
+      is_dropping_frame_ = false;
+    }
+
+    const std::size_t pending_bytes =
+        send_queue_size_in_bytes_ + buffered_amount_;
+    if (is_waiting_for_keyframe_) {
+      const bool has_caught_up =
+          pending_bytes <= frame_drop_policy_.non_reference_threshold_in_bytes;
+      if (!is_keyframe_start || !has_caught_up) {
+        if (is_frame_start) {
+          dropped_frame_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (is_keyframe_start) {
+          // The requested keyframe arrived too early, request another one
+          has_requested_keyframe_ = false;
+        }
+        if (has_caught_up && !has_requested_keyframe_) {
+          has_requested_keyframe_ = true;
+          requested_keyframe_count_.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+        return true;
+      }
+      is_waiting_for_keyframe_ = false;
+    } else if (pending_bytes + size_in_bytes >
+               frame_drop_policy_.keyframe_threshold_in_bytes) {
+      LOGW("Client fell behind, dropping frames until the next keyframe");
+      const auto queued_frame_count = std::count_if(
+          send_queue_.begin(), send_queue_.end(),
+          [](const EncodedFrame& frame) { return frame.part_index == 0; });
+      dropped_frame_count_.fetch_add(
+          static_cast<std::uint64_t>(queued_frame_count),
+          std::memory_order_relaxed);
+      send_queue_.clear();
+      send_queue_size_in_bytes_ = 0;
+      if (!is_keyframe_start) {
+        if (is_frame_start) {
+          dropped_frame_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+        is_waiting_for_keyframe_ = true;
+        has_requested_keyframe_ = false;
+        return true;
+      }
+    } else if (!encoded_frame.is_reference && is_frame_start &&
+               pending_bytes >
+                   frame_drop_policy_.non_reference_threshold_in_bytes) {
+      is_dropping_frame_ = true;
+      dropping_frame_index_ = encoded_frame.frame_index;
+      dropped_frame_count_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+
+    send_queue_.push_back(encoded_frame);
+    send_queue_size_in_bytes_ += size_in_bytes;
   }
+  send_queue_condition_.notify_one();
+  return true;
+}
+
+void Client::set_frame_drop_policy(const FrameDropPolicy& frame_drop_policy) {
+  std::lock_guard<std::mutex> lock(send_queue_mutex_);
+  frame_drop_policy_ = frame_drop_policy;
 }
 
 void Client::SwitchCodec(Codec codec, CodecOptions options) {
@@ -37,15 +120,47 @@ void Client::SwitchCodec(Codec codec, CodecOptions options) {
   requested_codec_ = codec;
   requested_codec_options_ = options;
   requested_codec_new_codec_ = true;
+  RequestUpdate();
 }
 
-void Client::Die() { is_alive_ = false; }
+void Client::Die() {
+  is_alive_ = false;
+  RequestUpdate();
+}
+
+void Client::set_buffered_amount(std::size_t buffered_amount) {
+  std::lock_guard<std::mutex> lock(send_queue_mutex_);
+  buffered_amount_ = buffered_amount;
+}
+
+void Client::StartSending() {
+  std::lock_guard<std::mutex> lock(send_queue_mutex_);
+  if (!is_sending_stopped_ && !send_thread_.joinable()) {
+    send_thread_ = std::thread(&Client::SendThread, this);
+  }
+}
+
+void Client::StopSending() {
+  {
+    std::lock_guard<std::mutex> lock(send_queue_mutex_);
+    is_sending_stopped_ = true;
+    send_queue_.clear();
+    send_queue_size_in_bytes_ = 0;
+  }
+  send_queue_condition_.notify_one();
+  if (send_thread_.joinable()) {
+    send_thread_.join();
+  }
+}
 
 void Client::AddEvent(Event::Ptr event) {
   auto timestamp = std::chrono::steady_clock::now();
   if (is_alive()) {
-    std::lock_guard<std::mutex> lock(events_mutex_);
-    events_.push_back(ClientEvent{this, timestamp, std::move(event)});
+    {
+      std::lock_guard<std::mutex> lock(events_mutex_);
+      events_.push_back(ClientEvent{this, timestamp, std::move(event)});
+    }
+    RequestUpdate();
   }
 }
 
@@ -64,10 +179,23 @@ bool Client::HasRequestedNewCodec(Codec* codec, CodecOptions* options) {
   return result;
 }
 
+void Client::KeepRequestedCodec(Codec codec, const CodecOptions& options) {
+  std::lock_guard<std::mutex> lock(requested_codec_mutex_);
+  if (!requested_codec_new_codec_) {
+    requested_codec_ = codec;
+    requested_codec_options_ = options;
+    requested_codec_new_codec_ = true;
+  }
+}
+
 void Client::SetNewCodec(Codec codec, const CodecOptions& options) {
-  if (is_alive()) {
-    OnCodecSwitched(codec, options);
+  {
+    std::lock_guard<std::mutex> lock(send_queue_mutex_);
+    has_pending_codec_switch_ = true;
+    pending_codec_ = codec;
+    pending_codec_options_ = options;
   }
+  send_queue_condition_.notify_one();
 }
 
 void Client::InsertEvents(std::vector<ClientEvent>* events) {
@@ -80,4 +208,56 @@ void Client::InsertEvents(std::vector<ClientEvent>* events) {
   events_.clear();
 }
 
+void Client::RequestUpdate() {
+  ClientSet* client_set = client_set_.load();
+  if (client_set != nullptr) {
+    client_set->RequestUpdate();
+  }
+}
+
+void Client::ClearSendQueue() {
+  std::lock_guard<std::mutex> lock(send_queue_mutex_);
+  send_queue_.clear();
+  send_queue_size_in_bytes_ = 0;
+  is_waiting_for_keyframe_ = false;
+  is_dropping_frame_ = false;
+}
+
+void Client::SendThread() {
+  while (true) {
+    EncodedFrame encoded_frame;
+    bool is_codec_switch = false;
+    Codec codec;
+    CodecOptions codec_options;
+    {
+      std::unique_lock<std::mutex> lock(send_queue_mutex_);
+      send_queue_condition_.wait(lock, [this]() {
+        return is_sending_stopped_ || has_pending_codec_switch_ ||
+               !send_queue_.empty();
+      });
+      if (is_sending_stopped_) {
+        return;
+      }
+      if (has_pending_codec_switch_) {
+        // The queued frames already belong to the new codec
+        has_pending_codec_switch_ = false;
+        is_codec_switch = true;
+        codec = pending_codec_;
+        codec_options = std::move(pending_codec_options_);
+      } else {
+        encoded_frame = std::move(send_queue_.front());
+        send_queue_.pop_front();
+        send_queue_size_in_bytes_ -= encoded_frame.serialized_frame->size();
+      }
+    }
+    if (is_codec_switch) {
+      if (is_alive()) {
+        OnCodecSwitched(codec, codec_options);
+      }
+    } else if (is_active()) {
+      OnFrameEncoded(encoded_frame);
+    }
+  }
+}
+
 }  // namespace webstreamer
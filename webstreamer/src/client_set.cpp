@@ -33,16 +33,25 @@
 
 namespace webstreamer {
 
-ClientSet::ClientSet(EncodingPipeline* encoding_pipeline)
-    : encoding_pipeline_(encoding_pipeline),
+ClientSet::ClientSet(EncodingPipeline* default_encoding_pipeline,
+                     std::chrono::milliseconds idle_backoff)
+    : default_encoding_pipeline_(default_encoding_pipeline),
+      idle_backoff_(idle_backoff),
       update_thread_(&ClientSet::UpdateThread, this) {}
 
 void ClientSet::Insert(std::unique_ptr<Client> client) {
-  std::lock_guard<std::mutex> lock(vector_access_mutex_);
-  clients_.push_back(std::move(client));
-  // A check whether the client is already in the set should
-  // not be needed as there should never be more than one
-  // unique_ptr pointing to an individual instance.
+  {
+    std::lock_guard<std::mutex> lock(vector_access_mutex_);
+    client->client_set_ = this;
+    client->set_frame_drop_policy(frame_drop_policy_);
+    client->StartSending();
+    clients_.push_back(std::move(client));
+    // A check whether the client is already in the set should
+    // not be needed as there should never be more than one
+    // unique_ptr pointing to an individual instance.
+  }
+  // The client may have received events before it has been inserted.
+  RequestUpdate();
 }
 
 void ClientSet::UpdateClients() {
@@ -53,13 +62,34 @@ void ClientSet::UpdateClients() {
       Codec new_codec;
       CodecOptions new_codec_options;
       if (client->HasRequestedNewCodec(&new_codec, &new_codec_options)) {
-        encoding_pipeline_->DeregisterClient(client.get());
-        if (encoding_pipeline_->RegisterClient(client.get(), new_codec,
-                                               new_codec_options)) {
-          client->SetNewCodec(new_codec, new_codec_options);
-          LOGI("Client changed codec!");
+        if (client->encoding_pipeline_ != nullptr) {
+          client->encoding_pipeline_->DeregisterClient(client.get());
+          client->encoding_pipeline_ = nullptr;
+          client->ClearSendQueue();
+        }
+        EncodingPipeline* encoding_pipeline =
+            GetEncodingPipeline(new_codec_options);
+        if (encoding_pipeline == nullptr) {
+          // The application may not have pushed a frame to the source yet,
+          // the request is retried on every update and by AddSource()
+          if (!client->is_waiting_for_source_) {
+            LOGW("Failed to change codec: unknown source!");
+            client->is_waiting_for_source_ = true;
+          }
+          client->KeepRequestedCodec(new_codec, new_codec_options);
         } else {
-          LOGW("Failed to change codec!");
+          // The switch is announced before the encoder replays its cached
+          // frames to the client, which are decoded with the new codec
+          client->SetNewCodec(new_codec, new_codec_options);
+          if (encoding_pipeline->RegisterClient(client.get(), new_codec,
+                                                new_codec_options)) {
+            client->is_waiting_for_source_ = false;
+            client->encoding_pipeline_ = encoding_pipeline;
+            LOGI("Client changed codec!");
+          } else {
+            client->is_waiting_for_source_ = false;
+            LOGW("Failed to change codec!");
+          }
         }
       }
     }
@@ -71,7 +101,14 @@ void ClientSet::UpdateClients() {
       std::remove_if(clients_.begin(), clients_.end(),
                      [this](const std::unique_ptr<Client>& client) {
                        if (!client->is_alive()) {
-                         encoding_pipeline_->DeregisterClient(client.get());
+                         if (client->encoding_pipeline_ != nullptr) {
+                           client->encoding_pipeline_->DeregisterClient(
+                               client.get());
+                         }
+                         removed_clients_dropped_frame_count_ +=
+                             client->dropped_frame_count();
+                         removed_clients_requested_keyframe_count_ +=
+                             client->requested_keyframe_count();
                          if (input_client_ == client.get()) {
                            client->owns_input_token_ = false;
                            input_client_ = nullptr;
@@ -98,10 +135,71 @@ void ClientSet::SetInputProcessor(InputProcessor* input_processor) {
   input_processor_ = input_processor;
 }
 
+void ClientSet::AddSource(const std::string& source_id,
+                          EncodingPipeline* encoding_pipeline) {
+  {
+    std::lock_guard<std::mutex> lock(vector_access_mutex_);
+    encoding_pipelines_[source_id] = encoding_pipeline;
+  }
+  // Serves the clients that requested the source before it existed
+  RequestUpdate();
+}
+
+void ClientSet::SetFrameDropPolicy(const FrameDropPolicy& frame_drop_policy) {
+  std::lock_guard<std::mutex> lock(vector_access_mutex_);
+  frame_drop_policy_ = frame_drop_policy;
+  for (const auto& client : clients_) {
+    client->set_frame_drop_policy(frame_drop_policy_);
+  }
+}
+
+std::uint64_t ClientSet::dropped_frame_count() {
+  std::lock_guard<std::mutex> lock(vector_access_mutex_);
+  std::uint64_t dropped_frame_count = removed_clients_dropped_frame_count_;
+  for (const auto& client : clients_) {
+    dropped_frame_count += client->dropped_frame_count();
+  }
+  return dropped_frame_count;
+}
+
+std::uint64_t ClientSet::requested_keyframe_count() {
+  std::lock_guard<std::mutex> lock(vector_access_mutex_);
+  std::uint64_t requested_keyframe_count =
+      removed_clients_requested_keyframe_count_;
+  for (const auto& client : clients_) {
+    requested_keyframe_count += client->requested_keyframe_count();
+  }
+  return requested_keyframe_count;
+}
+
+EncodingPipeline* ClientSet::GetEncodingPipeline(const CodecOptions& options) {
+  const std::string source_id =
+      options.optValue<std::string>(SOURCE_CODEC_OPTION, "");
+  if (source_id.empty()) {
+    return default_encoding_pipeline_;
+  }
+  const auto encoding_pipeline = encoding_pipelines_.find(source_id);
+  return encoding_pipeline != encoding_pipelines_.end()
+             ? encoding_pipeline->second
+             : nullptr;
+}
+
+void ClientSet::RequestUpdate() {
+  {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    update_requested_ = true;
+  }
+  update_requested_condition_.notify_one();
+}
+
 void ClientSet::UpdateThread() {
   while (true) {
     UpdateClients();
-    std::this_thread::yield();
+
+    std::unique_lock<std::mutex> lock(update_mutex_);
+    update_requested_condition_.wait_for(
+        lock, idle_backoff_, [this]() { return update_requested_; });
+    update_requested_ = false;
   }
 }
 
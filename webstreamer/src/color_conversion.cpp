@@ -0,0 +1,443 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "webstreamer/color_conversion.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include "webstreamer/worker_pool.hpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_IX86)
+#define WEBSTREAMER_COLOR_CONVERSION_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC allows intrinsics of all instruction sets in every function
+#define WEBSTREAMER_TARGET(instruction_set)
+#else
+#define WEBSTREAMER_TARGET(instruction_set) \
+  __attribute__((target(instruction_set)))
+#endif
+#else
+#define WEBSTREAMER_COLOR_CONVERSION_X86 0
+#endif
+
+namespace webstreamer {
+
+namespace {
+
+// BT.601 limited range coefficients with 8 fractional bits. The offsets of
+// the chroma planes are folded into the constants so all intermediate results
+// are positive. Chroma is computed from the sum of the four pixels of a 2x2
+// block, hence the two additional fractional bits.
+const int Y_R = 66;
+const int Y_G = 129;
+const int Y_B = 25;
+const int Y_CONSTANT = (16 << 8) + 128;
+const int U_R = -38;
+const int U_G = -74;
+const int U_B = 112;
+const int V_R = 112;
+const int V_G = -94;
+const int V_B = -18;
+const int CHROMA_CONSTANT = ((128 << 8) + 128) << 2;
+
+// Smaller slices do not pay off the synchronization overhead. Must be even.
+const std::size_t MIN_ROWS_PER_SLICE = 64;
+
+struct PackedLayout {
+  std::size_t red_offset;
+  std::size_t green_offset;
+  std::size_t blue_offset;
+  std::size_t bytes_per_pixel;
+};
+
+PackedLayout GetPackedLayout(PixelFormat pixel_format) {
+  switch (pixel_format) {
+    case PixelFormat::RGB:
+      return {0, 1, 2, 3};
+    case PixelFormat::BGR:
+      return {2, 1, 0, 3};
+    case PixelFormat::RGBA:
+      return {0, 1, 2, 4};
+    case PixelFormat::BGRA:
+      return {2, 1, 0, 4};
+    default:
+      assert(false);
+      return {0, 1, 2, 3};
+  }
+}
+
+inline std::uint8_t ComputeLuma(const PackedLayout& layout,
+                                const std::uint8_t* pixel) {
+  return static_cast<std::uint8_t>(
+      (Y_R * pixel[layout.red_offset] + Y_G * pixel[layout.green_offset] +
+       Y_B * pixel[layout.blue_offset] + Y_CONSTANT) >> 8);
+}
+
+// Converts the pixels starting at first_column (which must be even) of two
+// rows. row1 may be the same as row0 for the last row of frames with an odd
+// height, in which case luma1 is nullptr.
+void ConvertRowPairScalar(const PackedLayout& layout, const std::uint8_t* row0,
+                          const std::uint8_t* row1, std::size_t first_column,
+                          std::size_t width, std::uint8_t* luma0,
+                          std::uint8_t* luma1, std::uint8_t* u,
+                          std::uint8_t* v) {
+  const std::size_t bytes_per_pixel = layout.bytes_per_pixel;
+  for (std::size_t x = first_column; x < width; x += 2) {
+    // The last column of frames with an odd width is used twice
+    const std::size_t next_x = std::min(x + 1, width - 1);
+    const std::uint8_t* const pixels[4] = {
+        row0 + x * bytes_per_pixel, row0 + next_x * bytes_per_pixel,
+        row1 + x * bytes_per_pixel, row1 + next_x * bytes_per_pixel};
+
+    luma0[x] = ComputeLuma(layout, pixels[0]);
+    luma0[next_x] = ComputeLuma(layout, pixels[1]);
+    if (luma1 != nullptr) {
+      luma1[x] = ComputeLuma(layout, pixels[2]);
+      luma1[next_x] = ComputeLuma(layout, pixels[3]);
+    }
+
+    int red = 0;
+    int green = 0;
+    int blue = 0;
+    for (const std::uint8_t* pixel : pixels) {
+      red += pixel[layout.red_offset];
+      green += pixel[layout.green_offset];
+      blue += pixel[layout.blue_offset];
+    }
+    u[x / 2] = static_cast<std::uint8_t>(
+        (U_R * red + U_G * green + U_B * blue + CHROMA_CONSTANT) >> 10);
+    v[x / 2] = static_cast<std::uint8_t>(
+        (V_R * red + V_G * green + V_B * blue + CHROMA_CONSTANT) >> 10);
+  }
+}
+
+#if WEBSTREAMER_COLOR_CONVERSION_X86
+// The kernels expand four pixels to pairs of 16 bit words, red and green in
+// one vector and blue and zero in another, so that _mm_madd_epi16() computes
+// the weighted sums. The word pairs of adjacent pixels can be added with
+// 32 bit additions as the sums of four pixels fit into 16 bits.
+WEBSTREAMER_TARGET("sse4.1")
+__m128i CreateWordPairMask(std::size_t low_offset, std::size_t high_offset,
+                           std::size_t bytes_per_pixel) {
+  char mask[16];
+  for (std::size_t pixel = 0; pixel < 4; ++pixel) {
+    const std::size_t pixel_offset = pixel * bytes_per_pixel;
+    mask[4 * pixel] = static_cast<char>(pixel_offset + low_offset);
+    mask[4 * pixel + 1] = -1;
+    mask[4 * pixel + 2] = high_offset < bytes_per_pixel
+                              ? static_cast<char>(pixel_offset + high_offset)
+                              : -1;
+    mask[4 * pixel + 3] = -1;
+  }
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+inline int CreateWordPair(int low, int high) {
+  return static_cast<int>((static_cast<unsigned int>(high) << 16) |
+                          (static_cast<unsigned int>(low) & 0xffff));
+}
+
+WEBSTREAMER_TARGET("sse4.1")
+inline __m128i ConvertWordPairs(__m128i red_green, __m128i blue,
+                                __m128i red_green_coefficients,
+                                __m128i blue_coefficient, __m128i constant,
+                                int shift) {
+  return _mm_sra_epi32(
+      _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(red_green,
+                                                 red_green_coefficients),
+                                  _mm_madd_epi16(blue, blue_coefficient)),
+                    constant),
+      _mm_cvtsi32_si128(shift));
+}
+
+WEBSTREAMER_TARGET("sse4.1")
+inline __m128i PackToBytes(__m128i value) {
+  const __m128i packed_words = _mm_packus_epi32(value, value);
+  return _mm_packus_epi16(packed_words, packed_words);
+}
+
+WEBSTREAMER_TARGET("sse4.1")
+inline void StoreLow32(std::uint8_t* destination, __m128i value) {
+  const int low = _mm_cvtsi128_si32(value);
+  std::memcpy(destination, &low, 4);
+}
+
+WEBSTREAMER_TARGET("sse4.1")
+inline void StoreLow16(std::uint8_t* destination, __m128i value) {
+  const int low = _mm_cvtsi128_si32(value);
+  std::memcpy(destination, &low, 2);
+}
+
+// Returns the number of columns that have been converted, which is a multiple
+// of 4. Four pixels are loaded with a 16 byte load, so the last pixels of
+// packed RGB rows are left to the scalar code to not read past the row.
+WEBSTREAMER_TARGET("sse4.1")
+std::size_t ConvertRowPairSse41(const PackedLayout& layout,
+                                const std::uint8_t* row0,
+                                const std::uint8_t* row1, std::size_t width,
+                                std::uint8_t* luma0, std::uint8_t* luma1,
+                                std::uint8_t* u, std::uint8_t* v) {
+  const std::size_t bytes_per_pixel = layout.bytes_per_pixel;
+  const __m128i red_green_mask = CreateWordPairMask(
+      layout.red_offset, layout.green_offset, bytes_per_pixel);
+  const __m128i blue_mask =
+      CreateWordPairMask(layout.blue_offset, bytes_per_pixel, bytes_per_pixel);
+  const __m128i y_red_green = _mm_set1_epi32(CreateWordPair(Y_R, Y_G));
+  const __m128i y_blue = _mm_set1_epi32(Y_B);
+  const __m128i y_constant = _mm_set1_epi32(Y_CONSTANT);
+  const __m128i u_red_green = _mm_set1_epi32(CreateWordPair(U_R, U_G));
+  const __m128i u_blue = _mm_set1_epi32(U_B);
+  const __m128i v_red_green = _mm_set1_epi32(CreateWordPair(V_R, V_G));
+  const __m128i v_blue = _mm_set1_epi32(V_B & 0xffff);
+  const __m128i chroma_constant = _mm_set1_epi32(CHROMA_CONSTANT);
+
+  std::size_t x = 0;
+  for (; x + 4 <= width && x * bytes_per_pixel + 16 <= width * bytes_per_pixel;
+       x += 4) {
+    const __m128i pixels0 = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(row0 + x * bytes_per_pixel));
+    const __m128i pixels1 = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(row1 + x * bytes_per_pixel));
+    const __m128i red_green0 = _mm_shuffle_epi8(pixels0, red_green_mask);
+    const __m128i blue0 = _mm_shuffle_epi8(pixels0, blue_mask);
+    const __m128i red_green1 = _mm_shuffle_epi8(pixels1, red_green_mask);
+    const __m128i blue1 = _mm_shuffle_epi8(pixels1, blue_mask);
+
+    StoreLow32(luma0 + x,
+               PackToBytes(ConvertWordPairs(red_green0, blue0, y_red_green,
+                                            y_blue, y_constant, 8)));
+    if (luma1 != nullptr) {
+      StoreLow32(luma1 + x,
+                 PackToBytes(ConvertWordPairs(red_green1, blue1, y_red_green,
+                                              y_blue, y_constant, 8)));
+    }
+
+    // The lowest two lanes contain the sums of the two 2x2 blocks
+    const __m128i red_green_sum = _mm_add_epi16(red_green0, red_green1);
+    const __m128i blue_sum = _mm_add_epi16(blue0, blue1);
+    const __m128i red_green = _mm_hadd_epi32(red_green_sum, red_green_sum);
+    const __m128i blue = _mm_hadd_epi32(blue_sum, blue_sum);
+
+    StoreLow16(u + x / 2,
+               PackToBytes(ConvertWordPairs(red_green, blue, u_red_green,
+                                            u_blue, chroma_constant, 10)));
+    StoreLow16(v + x / 2,
+               PackToBytes(ConvertWordPairs(red_green, blue, v_red_green,
+                                            v_blue, chroma_constant, 10)));
+  }
+  return x;
+}
+
+WEBSTREAMER_TARGET("avx2")
+inline __m256i ConvertWordPairs(__m256i red_green, __m256i blue,
+                                __m256i red_green_coefficients,
+                                __m256i blue_coefficient, __m256i constant,
+                                int shift) {
+  return _mm256_sra_epi32(
+      _mm256_add_epi32(
+          _mm256_add_epi32(_mm256_madd_epi16(red_green, red_green_coefficients),
+                           _mm256_madd_epi16(blue, blue_coefficient)),
+          constant),
+      _mm_cvtsi32_si128(shift));
+}
+
+// Packs the 32 bit lanes to bytes. The bytes of the lower 128 bit half are
+// stored in the lowest four bytes of the result and the ones of the upper half
+// in the following four bytes.
+WEBSTREAMER_TARGET("avx2")
+inline __m128i PackToBytes(__m256i value) {
+  const __m256i packed_words = _mm256_packus_epi32(value, value);
+  const __m256i packed_bytes = _mm256_packus_epi16(packed_words, packed_words);
+  return _mm_unpacklo_epi32(_mm256_castsi256_si128(packed_bytes),
+                            _mm256_extracti128_si256(packed_bytes, 1));
+}
+
+// Same as ConvertRowPairSse41() for eight pixels at a time, the lower 128 bit
+// half of each vector contains the first four pixels.
+WEBSTREAMER_TARGET("avx2")
+std::size_t ConvertRowPairAvx2(const PackedLayout& layout,
+                               const std::uint8_t* row0,
+                               const std::uint8_t* row1, std::size_t width,
+                               std::uint8_t* luma0, std::uint8_t* luma1,
+                               std::uint8_t* u, std::uint8_t* v) {
+  const std::size_t bytes_per_pixel = layout.bytes_per_pixel;
+  const __m256i red_green_mask = _mm256_broadcastsi128_si256(CreateWordPairMask(
+      layout.red_offset, layout.green_offset, bytes_per_pixel));
+  const __m256i blue_mask = _mm256_broadcastsi128_si256(
+      CreateWordPairMask(layout.blue_offset, bytes_per_pixel, bytes_per_pixel));
+  const __m256i y_red_green = _mm256_set1_epi32(CreateWordPair(Y_R, Y_G));
+  const __m256i y_blue = _mm256_set1_epi32(Y_B);
+  const __m256i y_constant = _mm256_set1_epi32(Y_CONSTANT);
+  const __m256i u_red_green = _mm256_set1_epi32(CreateWordPair(U_R, U_G));
+  const __m256i u_blue = _mm256_set1_epi32(U_B);
+  const __m256i v_red_green = _mm256_set1_epi32(CreateWordPair(V_R, V_G));
+  const __m256i v_blue = _mm256_set1_epi32(V_B & 0xffff);
+  const __m256i chroma_constant = _mm256_set1_epi32(CHROMA_CONSTANT);
+
+  std::size_t x = 0;
+  for (; x + 8 <= width &&
+         (x + 4) * bytes_per_pixel + 16 <= width * bytes_per_pixel;
+       x += 8) {
+    const std::uint8_t* const pixels0 = row0 + x * bytes_per_pixel;
+    const std::uint8_t* const pixels1 = row1 + x * bytes_per_pixel;
+    const __m256i packed_pixels0 = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels0))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+            pixels0 + 4 * bytes_per_pixel)),
+        1);
+    const __m256i packed_pixels1 = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels1))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+            pixels1 + 4 * bytes_per_pixel)),
+        1);
+    const __m256i red_green0 =
+        _mm256_shuffle_epi8(packed_pixels0, red_green_mask);
+    const __m256i blue0 = _mm256_shuffle_epi8(packed_pixels0, blue_mask);
+    const __m256i red_green1 =
+        _mm256_shuffle_epi8(packed_pixels1, red_green_mask);
+    const __m256i blue1 = _mm256_shuffle_epi8(packed_pixels1, blue_mask);
+
+    const __m128i y0 = PackToBytes(ConvertWordPairs(
+        red_green0, blue0, y_red_green, y_blue, y_constant, 8));
+    StoreLow32(luma0 + x, y0);
+    StoreLow32(luma0 + x + 4, _mm_srli_si128(y0, 4));
+    if (luma1 != nullptr) {
+      const __m128i y1 = PackToBytes(ConvertWordPairs(
+          red_green1, blue1, y_red_green, y_blue, y_constant, 8));
+      StoreLow32(luma1 + x, y1);
+      StoreLow32(luma1 + x + 4, _mm_srli_si128(y1, 4));
+    }
+
+    // Each 128 bit half contains the sums of two 2x2 blocks in its lowest two
+    // lanes
+    const __m256i red_green_sum = _mm256_add_epi16(red_green0, red_green1);
+    const __m256i blue_sum = _mm256_add_epi16(blue0, blue1);
+    const __m256i red_green = _mm256_hadd_epi32(red_green_sum, red_green_sum);
+    const __m256i blue = _mm256_hadd_epi32(blue_sum, blue_sum);
+
+    const __m128i chroma_u = PackToBytes(ConvertWordPairs(
+        red_green, blue, u_red_green, u_blue, chroma_constant, 10));
+    const __m128i chroma_v = PackToBytes(ConvertWordPairs(
+        red_green, blue, v_red_green, v_blue, chroma_constant, 10));
+    StoreLow16(u + x / 2, chroma_u);
+    StoreLow16(u + x / 2 + 2, _mm_srli_si128(chroma_u, 4));
+    StoreLow16(v + x / 2, chroma_v);
+    StoreLow16(v + x / 2 + 2, _mm_srli_si128(chroma_v, 4));
+  }
+  return x;
+}
+#endif
+
+}  // namespace
+
+InstructionSet GetSupportedInstructionSet() {
+#if WEBSTREAMER_COLOR_CONVERSION_X86
+  static const InstructionSet supported_instruction_set = []() {
+#if defined(_MSC_VER)
+    int cpu_info[4];
+    __cpuid(cpu_info, 1);
+    const bool has_sse4_1 = (cpu_info[2] & (1 << 19)) != 0;
+    // AVX2 also requires the operating system to save the YMM registers
+    const bool has_os_ymm_support =
+        (cpu_info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(cpu_info, 7, 0);
+    const bool has_avx2 = has_os_ymm_support && (cpu_info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    const bool has_sse4_1 = __builtin_cpu_supports("sse4.1") != 0;
+    const bool has_avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+    return has_avx2 ? InstructionSet::AVX2
+                    : has_sse4_1 ? InstructionSet::SSE4_1
+                                 : InstructionSet::SCALAR;
+  }();
+  return supported_instruction_set;
+#else
+  return InstructionSet::SCALAR;
+#endif
+}
+
+void ConvertToI420(const void* source, std::size_t source_stride,
+                   PixelFormat source_format, std::size_t width,
+                   std::size_t height, std::uint8_t* const* planes,
+                   const std::size_t* strides, WorkerPool* worker_pool,
+                   InstructionSet instruction_set) {
+  assert(!IsPlanar(source_format));
+  const PackedLayout layout = GetPackedLayout(source_format);
+  auto source_bytes = static_cast<const std::uint8_t*>(source);
+
+  auto convert_rows = [&](std::size_t first_row, std::size_t end_row) {
+    for (std::size_t y = first_row; y < end_row; y += 2) {
+      const std::uint8_t* const row0 = source_bytes + y * source_stride;
+      const bool has_second_row = y + 1 < height;
+      const std::uint8_t* const row1 =
+          has_second_row ? row0 + source_stride : row0;
+      std::uint8_t* const luma0 = planes[0] + y * strides[0];
+      std::uint8_t* const luma1 =
+          has_second_row ? luma0 + strides[0] : nullptr;
+      std::uint8_t* const u = planes[1] + y / 2 * strides[1];
+      std::uint8_t* const v = planes[2] + y / 2 * strides[2];
+
+      std::size_t first_column = 0;
+#if WEBSTREAMER_COLOR_CONVERSION_X86
+      if (instruction_set == InstructionSet::AVX2) {
+        first_column =
+            ConvertRowPairAvx2(layout, row0, row1, width, luma0, luma1, u, v);
+      } else if (instruction_set == InstructionSet::SSE4_1) {
+        first_column =
+            ConvertRowPairSse41(layout, row0, row1, width, luma0, luma1, u, v);
+      }
+#else
+      (void)instruction_set;
+#endif
+      ConvertRowPairScalar(layout, row0, row1, first_column, width, luma0,
+                           luma1, u, v);
+    }
+  };
+
+  std::size_t slice_count = 1;
+  if (worker_pool != nullptr) {
+    slice_count =
+        std::min(worker_pool->thread_count() + 1, height / MIN_ROWS_PER_SLICE);
+  }
+
+  if (slice_count <= 1) {
+    convert_rows(0, height);
+  } else {
+    // Slices start at even rows so they do not share chroma rows
+    const std::size_t rows_per_slice = height / slice_count / 2 * 2;
+    worker_pool->ParallelFor(slice_count, [&](std::size_t slice) {
+      const std::size_t first_row = slice * rows_per_slice;
+      const std::size_t end_row = slice + 1 == slice_count
+                                      ? height
+                                      : first_row + rows_per_slice;
+      convert_rows(first_row, end_row);
+    });
+  }
+}
+
+}  // namespace webstreamer
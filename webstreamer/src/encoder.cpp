@@ -24,57 +24,242 @@
 #include <algorithm>
 #include <cassert>
 #include "webstreamer/client.hpp"
+#include "webstreamer/encoded_frame_header.hpp"
+#include "webstreamer/frame_buffer.hpp"
 
 namespace webstreamer {
 
+namespace {
+
+// Larger GOPs are not cached, clients that join then force a keyframe. This
+// also bounds the burst of data a joining client receives.
+const std::size_t MAX_GOP_CACHE_SIZE_IN_BYTES = 4 * 1024 * 1024;
+
+// Bounds the timestamps kept for encoders with delayed output, x264 delays
+// frames by its lookahead and frame threads at most.
+const std::size_t MAX_PENDING_FRAME_COUNT = 256;
+
+}  // namespace
+
 Encoder::Encoder() : idle_time_(true) {}
 
 void Encoder::RegisterClient(Client* client) {
   std::lock_guard<std::mutex> lock(clients_access_mutex_);
 #ifndef NDEBUG
-  for (auto c : clients_) {
-    assert(c != client);
+  for (const auto& registered_client : clients_) {
+    assert(registered_client.client != client);
   }
 #endif
-  clients_.push_back(client);
-  has_new_client_ = true;
+  // Replaying the cached frames while holding the lock makes sure the client
+  // receives the live frames right after them.
+  for (const EncodedFrame& encoded_frame : gop_cache_) {
+    if (!client->PushFrame(encoded_frame)) {
+      is_keyframe_requested_.store(true, std::memory_order_relaxed);
+    }
+  }
+  const bool is_waiting_for_keyframe = gop_cache_.empty();
+  clients_.push_back(RegisteredClient{client, is_waiting_for_keyframe});
+  if (is_waiting_for_keyframe) {
+    waiting_client_count_.fetch_add(1, std::memory_order_relaxed);
+  }
   idle_time_.Stop();
   idle_time_.Reset();
 }
 
 void Encoder::DeregisterClient(Client* client) {
   std::lock_guard<std::mutex> lock(clients_access_mutex_);
-  clients_.erase(std::remove(clients_.begin(), clients_.end(), client),
-                 clients_.end());
+  const auto registered_client = std::find_if(
+      clients_.begin(), clients_.end(),
+      [client](const RegisteredClient& candidate) {
+        return candidate.client == client;
+      });
+  if (registered_client != clients_.end()) {
+    if (registered_client->is_waiting_for_keyframe) {
+      waiting_client_count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    clients_.erase(registered_client);
+  }
   if (clients_.size() == 0) {
 	  idle_time_.Start();
+    // Frames are not encoded without clients, so the cache would be stale
+    ClearGopCache();
   }
 }
 
-void Encoder::PushFrame(const FrameBuffer& frame_buffer) {
+void Encoder::PushFrame(const FrameBuffer& frame_buffer,
+                        bool has_missed_deadline) {
   {
     std::lock_guard<std::mutex> lock(clients_access_mutex_);
     bool has_active_clients = false;
-    for (const auto& client : clients_) {
-      if (client->is_active()) {
+    for (const auto& registered_client : clients_) {
+      if (registered_client.client->is_active()) {
         has_active_clients = true;
         break;
       }
     }
     if (!has_active_clients) {
+      last_frame_index_ = 0;
+      // Nobody waits for the frames the encoder holds back anymore
+      pending_frames_.clear();
       return;
     }
   }
-  SendEncodedFrameToRegisteredClients(EncodeFrame(frame_buffer));
-  has_new_client_ = false;
+
+  const std::uint64_t frame_index = frame_buffer.info().frame_index;
+  if (last_frame_index_ != 0 && frame_index > last_frame_index_ + 1) {
+    auto& skipped_frame_count =
+        has_missed_deadline ? dropped_frame_count_ : decimated_frame_count_;
+    skipped_frame_count.fetch_add(frame_index - last_frame_index_ - 1,
+                                  std::memory_order_relaxed);
+  }
+  last_frame_index_ = frame_index;
+
+  // Frames of the same encoder have similar sizes, so reserving the size of
+  // the previous frame avoids growing the buffer while encoding.
+  auto serialized_frame =
+      std::make_shared<std::vector<std::uint8_t>>(ENCODED_FRAME_DATA_OFFSET);
+  serialized_frame->reserve(last_serialized_frame_size_);
+
+  encoding_frame_.frame_index = frame_buffer.info().frame_index;
+  encoding_frame_.push_timestamp = frame_buffer.info().push_timestamp;
+  encoding_frame_.encode_start_timestamp = std::chrono::system_clock::now();
+  encoding_frame_.part_index = 0;
+  if (pending_frames_.size() == MAX_PENDING_FRAME_COUNT) {
+    pending_frames_.pop_front();
+  }
+  pending_frames_.push_back(PendingFrame{
+      encoding_frame_.frame_index, encoding_frame_.push_timestamp,
+      encoding_frame_.encode_start_timestamp});
+
+  EncodedFrame encoded_frame =
+      EncodeFrame(frame_buffer, serialized_frame.get());
+  if (encoding_frame_.part_index == 0) {
+    SendEncodedFrame(&encoded_frame, std::move(serialized_frame));
+  } else {
+    // Streamed frames are sent as they are encoded
+    pending_frames_.clear();
+  }
+}
+
+void Encoder::Flush(const FrameBuffer& latest_frame_buffer) {
+  // The repeated frames share the frame index of the latest frame, so the
+  // pending frames are done once the encoder returns the latest frame. The
+  // repetitions it holds back in turn are sent with the next frames.
+  for (std::size_t i = 0; i < MAX_PENDING_FRAME_COUNT &&
+                          !pending_frames_.empty() && has_delayed_frames();
+       ++i) {
+    PushFrame(latest_frame_buffer, false);
+  }
+}
+
+void Encoder::SendEncodedFrame(
+    EncodedFrame* encoded_frame,
+    std::shared_ptr<std::vector<std::uint8_t>> serialized_frame) {
+  // Frames without payload (e.g., because encoding failed) are not sent, they
+  // must neither release waiting clients nor reset the GOP cache.
+  if (serialized_frame->size() <= ENCODED_FRAME_DATA_OFFSET) {
+    return;
+  }
+
+  if (encoded_frame->frame_index == 0) {
+    encoded_frame->frame_index = encoding_frame_.frame_index;
+  }
+  encoded_frame->push_timestamp = encoding_frame_.push_timestamp;
+  encoded_frame->encode_start_timestamp =
+      encoding_frame_.encode_start_timestamp;
+  while (!pending_frames_.empty() &&
+         pending_frames_.front().frame_index <= encoded_frame->frame_index) {
+    if (pending_frames_.front().frame_index == encoded_frame->frame_index) {
+      encoded_frame->push_timestamp = pending_frames_.front().push_timestamp;
+      encoded_frame->encode_start_timestamp =
+          pending_frames_.front().encode_start_timestamp;
+    }
+    pending_frames_.pop_front();
+  }
+  encoded_frame->encode_end_timestamp = std::chrono::system_clock::now();
+  encoded_frame->part_index = 0;
+  encoded_frame->is_last_part = true;
+
+  last_serialized_frame_size_ = serialized_frame->size();
+  SendSerializedFrame(encoded_frame, std::move(serialized_frame));
+}
+
+void Encoder::SendEncodedFramePart(std::size_t width, std::size_t height,
+                                   const std::uint8_t* data,
+                                   std::size_t size_in_bytes,
+                                   bool is_keyframe, bool is_reference,
+                                   bool is_last_part) {
+  auto serialized_frame =
+      std::make_shared<std::vector<std::uint8_t>>(ENCODED_FRAME_DATA_OFFSET);
+  serialized_frame->insert(serialized_frame->end(), data,
+                           data + size_in_bytes);
+
+  EncodedFrame encoded_frame = encoding_frame_;
+  encoded_frame.width = width;
+  encoded_frame.height = height;
+  encoded_frame.encode_end_timestamp = std::chrono::system_clock::now();
+  encoded_frame.is_keyframe = is_keyframe;
+  encoded_frame.is_reference = is_reference;
+  encoded_frame.is_last_part = is_last_part;
+  ++encoding_frame_.part_index;
+
+  SendSerializedFrame(&encoded_frame, std::move(serialized_frame));
+}
+
+void Encoder::SendSerializedFrame(
+    EncodedFrame* encoded_frame,
+    std::shared_ptr<std::vector<std::uint8_t>> serialized_frame) {
+  SerializeEncodedFrameHeader(*encoded_frame, serialized_frame.get());
+  encoded_frame->data = serialized_frame->data() + ENCODED_FRAME_DATA_OFFSET;
+  encoded_frame->size_in_bytes =
+      serialized_frame->size() - ENCODED_FRAME_DATA_OFFSET;
+  encoded_frame->serialized_frame = std::move(serialized_frame);
+
+  SendEncodedFrameToRegisteredClients(*encoded_frame);
 }
 
 void Encoder::SendEncodedFrameToRegisteredClients(
     const EncodedFrame& encoded_frame) {
   std::lock_guard<std::mutex> lock(clients_access_mutex_);
-  for (auto client : clients_) {
-    client->PushFrame(encoded_frame);
+  UpdateGopCache(encoded_frame);
+  if (encoded_frame.is_keyframe && encoded_frame.part_index == 0) {
+    is_keyframe_requested_.store(false, std::memory_order_relaxed);
   }
+  for (auto& registered_client : clients_) {
+    // Clients start with the first part of a keyframe
+    if (registered_client.is_waiting_for_keyframe) {
+      if (!encoded_frame.is_keyframe || encoded_frame.part_index != 0) {
+        continue;
+      }
+      registered_client.is_waiting_for_keyframe = false;
+      waiting_client_count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if (!registered_client.client->PushFrame(encoded_frame)) {
+      is_keyframe_requested_.store(true, std::memory_order_relaxed);
+    }
+  }
+}
+
+void Encoder::UpdateGopCache(const EncodedFrame& encoded_frame) {
+  if (encoded_frame.is_keyframe && encoded_frame.part_index == 0) {
+    ClearGopCache();
+  } else if (gop_cache_.empty()) {
+    // The cache must start with a keyframe
+    return;
+  }
+
+  const std::size_t size_in_bytes = encoded_frame.serialized_frame->size();
+  if (gop_cache_size_in_bytes_ + size_in_bytes > MAX_GOP_CACHE_SIZE_IN_BYTES) {
+    ClearGopCache();
+    return;
+  }
+  gop_cache_.push_back(encoded_frame);
+  gop_cache_size_in_bytes_ += size_in_bytes;
+}
+
+void Encoder::ClearGopCache() {
+  gop_cache_.clear();
+  gop_cache_size_in_bytes_ = 0;
 }
 
 }  // namespace webstreamer
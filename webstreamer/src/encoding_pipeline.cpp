@@ -21,21 +21,111 @@
 //------------------------------------------------------------------------------
 
 #include "webstreamer/encoding_pipeline.hpp"
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include "log.hpp"
 #include "webstreamer/encoder.hpp"
 #include "webstreamer/encoder_factory.hpp"
+#include "webstreamer/frame_copy.hpp"
+#include "webstreamer/frame_hash.hpp"
 #include "webstreamer/raw_encoder.hpp"
 
 namespace webstreamer {
 
-EncodingPipeline::EncodingPipeline()
-    : writing_frame_buffer_(&frame_buffers_[0]),
-      writing_frame_index_(0),
-      encoding_frame_buffer_(&frame_buffers_[1]),
-      encoding_frame_index_(0),
-      swap_thread_(&EncodingPipeline::SwapThread, this) {}
+namespace {
+
+std::size_t GetPlaneSubsampling(std::size_t plane) {
+  return plane == 0 ? 1 : 2;
+}
+
+std::size_t GetPlaneBytesPerPixel(PixelFormat pixel_format,
+                                  std::size_t plane) {
+  if (plane == 0) {
+    return GetBytesPerPixel(pixel_format);
+  } else {
+    return pixel_format == PixelFormat::NV12 ? 2 : 1;
+  }
+}
+
+std::size_t GetArea(const std::vector<Rect>& regions) {
+  std::size_t area = 0;
+  for (const Rect& region : regions) {
+    area += region.width * region.height;
+  }
+  return area;
+}
+
+// Copies the given regions of the source frame to the frame buffer. The regions
+// are given in the coordinates of the frame buffer.
+void CopyRegions(FrameBuffer* frame_buffer, const std::uint8_t* source,
+                 const PlaneLayout* source_planes,
+                 const std::vector<Rect>& regions, bool flip_vertically) {
+  for (std::size_t plane = 0; plane < frame_buffer->plane_count(); ++plane) {
+    const std::size_t subsampling = GetPlaneSubsampling(plane);
+    const std::size_t bytes_per_pixel =
+        GetPlaneBytesPerPixel(frame_buffer->pixel_format(), plane);
+    const std::size_t plane_height = frame_buffer->GetPlaneHeight(plane);
+    const std::size_t stride = frame_buffer->GetPlaneStride(plane);
+    const PlaneLayout& source_plane = source_planes[plane];
+
+    // Subsampled planes are flipped as a whole, so for odd frame heights the
+    // rows have to be mapped from the bottom of the frame.
+    const std::size_t frame_height = frame_buffer->height();
+    auto get_plane_row = [&](std::size_t row) {
+      return flip_vertically
+                 ? plane_height - 1 - (frame_height - 1 - row) / subsampling
+                 : row / subsampling;
+    };
+
+    for (const Rect& region : regions) {
+      const std::size_t left = region.x / subsampling;
+      const std::size_t right =
+          (region.x + region.width + subsampling - 1) / subsampling;
+      const std::size_t top = get_plane_row(region.y);
+      const std::size_t bottom =
+          get_plane_row(region.y + region.height - 1) + 1;
+      const std::size_t source_top =
+          flip_vertically ? plane_height - bottom : top;
+
+      CopyRows(static_cast<std::uint8_t*>(
+                   frame_buffer->GetPlaneRowData(plane, top)) +
+                   left * bytes_per_pixel,
+               stride,
+               source + source_plane.offset +
+                   source_top * source_plane.stride + left * bytes_per_pixel,
+               source_plane.stride, (right - left) * bytes_per_pixel,
+               bottom - top, flip_vertically);
+    }
+  }
+}
+
+}  // namespace
+
+EncodingPipeline::EncodingPipeline(std::size_t frame_ring_size,
+                                   std::chrono::milliseconds idle_backoff,
+                                   std::shared_ptr<WorkerPool> worker_pool,
+                                   std::size_t stride_alignment,
+                                   bool use_huge_pages,
+                                   bool deduplicate_frames)
+    : frame_ring_(frame_ring_size, stride_alignment, use_huge_pages),
+      idle_backoff_(idle_backoff),
+      worker_pool_(worker_pool != nullptr
+                       ? std::move(worker_pool)
+                       : std::make_shared<WorkerPool>(
+                             DEFAULT_WORKER_THREAD_COUNT)),
+      is_writing_(false),
+      writing_frame_buffer_(nullptr),
+      remaining_tile_count_(0),
+      is_tiled_frame_flipped_(false),
+      damage_history_last_frame_index_(0),
+      damage_history_width_(0),
+      damage_history_height_(0),
+      damage_history_pixel_format_(PixelFormat::RGB),
+      deduplicate_frames_(deduplicate_frames),
+      latest_frame_hash_(0),
+      deduplicated_frame_count_(0) {}
 
 void EncodingPipeline::RegisterEncoderFactoryForCodec(Codec codec,
                                                       EncoderFactory* factory) {
@@ -62,6 +152,12 @@ bool EncodingPipeline::RegisterClient(Client* client, Codec codec,
     std::unique_ptr<Encoder> encoder =
         encoder_factories_[codec]->CreateEncoder(options);
 
+    encoder->set_worker_pool(worker_pool_.get());
+    if (encoder->prefers_i420() && encoder->preferred_input_width() > 0 &&
+        encoder->preferred_input_height() > 0) {
+      frame_ring_.AddPyramidLevel(encoder->preferred_input_width(),
+                                  encoder->preferred_input_height());
+    }
     encoder->RegisterClient(client);
     encoders_.push_back(std::move(encoder));
     encoder_threads_.emplace_back(&EncodingPipeline::EncoderThread, this,
@@ -80,87 +176,320 @@ void EncodingPipeline::DeregisterClient(Client* client) {
 }
 
 void EncodingPipeline::PushFrame(std::size_t width, std::size_t height,
-                                 const void* rgb_data,
+                                 const void* pixel_data,
+                                 std::size_t size_in_bytes,
+                                 bool flip_vertically,
+                                 PixelFormat pixel_format) {
+  const std::vector<Rect> damaged_regions = {{0, 0, width, height}};
+  PushFrame(width, height, pixel_data, size_in_bytes, damaged_regions,
+            flip_vertically, pixel_format);
+}
+
+void EncodingPipeline::PushFrame(std::size_t width, std::size_t height,
+                                 const void* pixel_data,
                                  std::size_t size_in_bytes,
-                                 bool flip_vertically) {
+                                 const std::vector<Rect>& damaged_regions,
+                                 bool flip_vertically,
+                                 PixelFormat pixel_format) {
   (void)size_in_bytes;
-  std::lock_guard<std::mutex> writing_lock(writing_frame_buffer_mutex_);
-
-  writing_frame_buffer_->ResizeIfNecessary(width, height);
-  assert(size_in_bytes == writing_frame_buffer_->size_in_bytes());
-  if (flip_vertically) {
-    auto current_source_line = reinterpret_cast<const std::uint8_t*>(rgb_data);
-    const std::size_t stride =
-        writing_frame_buffer_->stride();  // The alignment of the source data
-                                          // has the same requirements as the
-                                          // alignment in the frame buffer
-
-    for (std::size_t row = height; row != 0;
-         --row, current_source_line += stride) {
-      std::memcpy(writing_frame_buffer_->GetRowData(row - 1),
-                  current_source_line, stride);
+  PlaneLayout source_planes[MAX_PLANE_COUNT];
+  const std::size_t source_size =
+      CalculateFrameLayout(width, height, pixel_format,
+                           PUSH_FRAME_STRIDE_ALIGNMENT, source_planes);
+  (void)source_size;
+  assert(size_in_bytes == source_size);
+
+  // Clip the regions to the frame and convert them to the coordinates of the
+  // frame buffer
+  std::vector<Rect> frame_damage;
+  frame_damage.reserve(damaged_regions.size());
+  for (const Rect& region : damaged_regions) {
+    if (region.x >= width || region.y >= height) {
+      continue;
+    }
+    Rect clipped_region = {region.x, region.y,
+                           std::min(region.width, width - region.x),
+                           std::min(region.height, height - region.y)};
+    if (clipped_region.width == 0 || clipped_region.height == 0) {
+      continue;
+    }
+    if (flip_vertically) {
+      clipped_region.y = height - clipped_region.y - clipped_region.height;
     }
+    frame_damage.push_back(clipped_region);
+  }
+  if (frame_damage.empty()) {
+    LOGV("Dropped frame without damaged regions");
+    return;
+  }
+
+  FrameBuffer& frame_buffer = AcquireWriteFrame(width, height, pixel_format);
+
+  // The frame buffer still contains an older frame, so everything that changed
+  // since then has to be copied as well.
+  std::vector<Rect> outdated_regions = frame_damage;
+  const bool is_outdated_region_known = CollectDamageSince(
+      frame_buffer.info().frame_index, frame_buffer, &outdated_regions);
+  frame_buffer.info().damaged_regions = std::move(frame_damage);
+
+  auto source = static_cast<const std::uint8_t*>(pixel_data);
+  if (is_outdated_region_known &&
+      2 * GetArea(outdated_regions) < width * height) {
+    CopyRegions(&frame_buffer, source, source_planes, outdated_regions,
+                flip_vertically);
   } else {
-    std::memcpy(writing_frame_buffer_->pixel_data(), rgb_data,
-                writing_frame_buffer_->size_in_bytes());
+    for (std::size_t plane = 0; plane < frame_buffer.plane_count(); ++plane) {
+      CopyRows(frame_buffer.GetPlaneData(plane),
+               frame_buffer.GetPlaneStride(plane),
+               source + source_planes[plane].offset,
+               source_planes[plane].stride, source_planes[plane].row_size,
+               source_planes[plane].height, flip_vertically,
+               worker_pool_.get());
+    }
   }
+  CommitFrame();
+}
 
-  // Relaxed is fine here, as this is the only thread that writes to that value
-  const std::size_t writing_frame_index =
-      writing_frame_index_.load(std::memory_order_relaxed);
-  writing_frame_index_.store(writing_frame_index + 1,
-                             std::memory_order_release);
+FrameBuffer& EncodingPipeline::AcquireWriteFrame(std::size_t width,
+                                                 std::size_t height,
+                                                 PixelFormat pixel_format) {
+  // Released in CommitFrame()
+  BeginWriting();
+  FrameBuffer& frame_buffer = frame_ring_.BeginWrite();
+  frame_buffer.ResizeIfNecessary(width, height, pixel_format);
+  frame_buffer.info().push_timestamp = std::chrono::system_clock::now();
+  frame_buffer.info().damaged_regions.assign(1, Rect{0, 0, width, height});
+  writing_frame_buffer_ = &frame_buffer;
+  return frame_buffer;
 }
 
-void EncodingPipeline::EncoderThread(Encoder* encoder) {
-  std::size_t last_encoded_frame_index_ = 0;
-  while (true) {
-    const std::size_t approximate_encoding_frame_index =
-        encoding_frame_index_.load(std::memory_order_relaxed);
-
-    if (approximate_encoding_frame_index != last_encoded_frame_index_) {
-#if SHARED_MUTEX_SUPPORTED
-      std::shared_lock<std::shared_timed_mutex> encoding_lock(
-          encoding_frame_buffer_mutex_);
-#else
-      std::lock_guard<std::mutex> encoding_lock(encoding_frame_buffer_mutex_);
-#endif
-
-      LOGV("Encode frame from: ", encoding_frame_buffer_);
-      encoder->PushFrame(*encoding_frame_buffer_);
-      const std::size_t actual_encoding_frame_index =
-          encoding_frame_index_.load(std::memory_order_acquire);
-
-      last_encoded_frame_index_ = actual_encoding_frame_index;
-    } else {
-      std::this_thread::yield();
+void EncodingPipeline::CommitFrame() {
+  assert(writing_frame_buffer_ != nullptr);
+
+  if (deduplicate_frames_) {
+    const FrameBuffer& frame_buffer = *writing_frame_buffer_;
+    const std::uint64_t frame_hash =
+        HashFrame(frame_buffer, worker_pool_.get());
+    const bool is_duplicate =
+        damage_history_last_frame_index_ != 0 &&
+        frame_hash == latest_frame_hash_ &&
+        frame_buffer.width() == damage_history_width_ &&
+        frame_buffer.height() == damage_history_height_ &&
+        frame_buffer.pixel_format() == damage_history_pixel_format_;
+    latest_frame_hash_ = frame_hash;
+
+    if (is_duplicate) {
+      // The slot now contains a copy of the latest frame, so the damage
+      // history is still valid for it.
+      frame_ring_.CancelWrite();
+      writing_frame_buffer_ = nullptr;
+      EndWriting();
+      deduplicated_frame_count_.fetch_add(1, std::memory_order_relaxed);
+      LOGV("Dropped frame that is identical to the previous one");
+      return;
     }
   }
+
+  frame_ring_.Publish();
+  // The encoders only read the frame from now on, so it is safe to read it here
+  // as well.
+  RecordDamage(*writing_frame_buffer_);
+  writing_frame_buffer_ = nullptr;
+  EndWriting();
+
+  {
+    // Prevents the notification from getting lost between the predicate check
+    // and the wait of an encoder thread.
+    std::lock_guard<std::mutex> lock(frame_published_mutex_);
+  }
+  frame_published_.notify_all();
 }
 
-void EncodingPipeline::SwapThread() {
+void EncodingPipeline::BeginTiledFrame(std::size_t width, std::size_t height,
+                                       std::size_t tile_count,
+                                       bool flip_vertically,
+                                       PixelFormat pixel_format) {
+  assert(!IsPlanar(pixel_format));
+  assert(tile_count > 0);
+  AcquireWriteFrame(width, height, pixel_format);
+  is_tiled_frame_flipped_ = flip_vertically;
+  remaining_tile_count_.store(tile_count, std::memory_order_release);
+}
+
+void EncodingPipeline::WriteTile(const Rect& tile, const void* pixel_data,
+                                 std::size_t source_stride) {
+  assert(writing_frame_buffer_ != nullptr);
+  FrameBuffer& frame_buffer = *writing_frame_buffer_;
+  assert(tile.x + tile.width <= frame_buffer.width());
+  assert(tile.y + tile.height <= frame_buffer.height());
+
+  const std::size_t bytes_per_pixel =
+      GetBytesPerPixel(frame_buffer.pixel_format());
+  const std::size_t row_size = tile.width * bytes_per_pixel;
+  if (source_stride == 0) {
+    source_stride =
+        (row_size + PUSH_FRAME_STRIDE_ALIGNMENT - 1) /
+        PUSH_FRAME_STRIDE_ALIGNMENT * PUSH_FRAME_STRIDE_ALIGNMENT;
+  }
+  const std::size_t top =
+      is_tiled_frame_flipped_ ? frame_buffer.height() - tile.y - tile.height
+                              : tile.y;
+
+  // The tiles do not overlap, so they can be copied concurrently. Large tiles
+  // are not split up further as the producers already run in parallel.
+  CopyRows(static_cast<std::uint8_t*>(frame_buffer.GetPlaneRowData(0, top)) +
+               tile.x * bytes_per_pixel,
+           frame_buffer.GetPlaneStride(0), pixel_data, source_stride, row_size,
+           tile.height, is_tiled_frame_flipped_);
+
+  // The thread that writes the last tile synchronizes with all others and
+  // publishes the frame.
+  if (remaining_tile_count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    CommitFrame();
+  }
+}
+
+std::uint64_t EncodingPipeline::dropped_frame_count() {
+  std::lock_guard<std::mutex> lock(encoders_access_mutex_);
+  std::uint64_t dropped_frame_count = 0;
+  for (const auto& encoder : encoders_) {
+    dropped_frame_count += encoder->dropped_frame_count();
+  }
+  return dropped_frame_count;
+}
+
+std::uint64_t EncodingPipeline::decimated_frame_count() {
+  std::lock_guard<std::mutex> lock(encoders_access_mutex_);
+  std::uint64_t decimated_frame_count = 0;
+  for (const auto& encoder : encoders_) {
+    decimated_frame_count += encoder->decimated_frame_count();
+  }
+  return decimated_frame_count;
+}
+
+void EncodingPipeline::BeginWriting() {
+  std::unique_lock<std::mutex> lock(writing_mutex_);
+  writing_finished_.wait(lock, [this]() { return !is_writing_; });
+  is_writing_ = true;
+}
+
+void EncodingPipeline::EndWriting() {
+  {
+    std::lock_guard<std::mutex> lock(writing_mutex_);
+    is_writing_ = false;
+  }
+  writing_finished_.notify_one();
+}
+
+void EncodingPipeline::RecordDamage(const FrameBuffer& frame_buffer) {
+  if (frame_buffer.width() != damage_history_width_ ||
+      frame_buffer.height() != damage_history_height_ ||
+      frame_buffer.pixel_format() != damage_history_pixel_format_) {
+    damage_history_.clear();
+    damage_history_width_ = frame_buffer.width();
+    damage_history_height_ = frame_buffer.height();
+    damage_history_pixel_format_ = frame_buffer.pixel_format();
+  }
+
+  damage_history_.push_back(frame_buffer.info().damaged_regions);
+  damage_history_last_frame_index_ = frame_buffer.info().frame_index;
+  if (damage_history_.size() > frame_ring_.size()) {
+    damage_history_.pop_front();
+  }
+}
+
+bool EncodingPipeline::CollectDamageSince(
+    std::uint64_t frame_index, const FrameBuffer& frame_buffer,
+    std::vector<Rect>* damaged_regions) const {
+  if (frame_index == 0 || frame_buffer.width() != damage_history_width_ ||
+      frame_buffer.height() != damage_history_height_ ||
+      frame_buffer.pixel_format() != damage_history_pixel_format_) {
+    return false;
+  }
+
+  const std::uint64_t first_frame_index =
+      damage_history_last_frame_index_ + 1 - damage_history_.size();
+  if (frame_index < first_frame_index) {
+    return false;
+  }
+
+  for (std::uint64_t i = frame_index + 1; i <= damage_history_last_frame_index_;
+       ++i) {
+    const std::vector<Rect>& regions = damage_history_[i - first_frame_index];
+    damaged_regions->insert(damaged_regions->end(), regions.begin(),
+                            regions.end());
+  }
+  return true;
+}
+
+void EncodingPipeline::EncoderThread(Encoder* encoder) {
+  std::uint64_t last_encoded_frame_index = 0;
+  const int framerate = encoder->framerate();
+  const std::chrono::steady_clock::duration frame_interval =
+      framerate > 0 ? std::chrono::steady_clock::duration(
+                          std::chrono::seconds(1)) /
+                          framerate
+                    : std::chrono::steady_clock::duration::zero();
+  std::chrono::steady_clock::time_point next_encode_time =
+      std::chrono::steady_clock::now();
+  // Whether the encoder finished the previous frame after the next frame
+  // interval started. Without a framerate, every frame that is skipped is
+  // skipped because the encoder was busy.
+  bool has_missed_deadline = false;
+
   while (true) {
-    const std::size_t approximate_writing_frame_index =
-        writing_frame_index_.load(std::memory_order_relaxed);
-
-    if (approximate_writing_frame_index != encoding_frame_index_) {
-#if SHARED_MUTEX_SUPPORTED
-      std::shared_lock<std::shared_timed_mutex> encoding_lock(
-          encoding_frame_buffer_mutex_);
-#else
-      std::lock_guard<std::mutex> encoding_lock(encoding_frame_buffer_mutex_);
-#endif
-      std::lock_guard<std::mutex> writing_lock(writing_frame_buffer_mutex_);
-
-      std::swap(encoding_frame_buffer_, writing_frame_buffer_);
-
-      const std::size_t actual_writing_frame_index =
-          writing_frame_index_.load(std::memory_order_acquire);
-      encoding_frame_index_.store(actual_writing_frame_index,
-                                  std::memory_order_release);
-    } else {
-      std::this_thread::yield();
+    {
+      std::unique_lock<std::mutex> lock(frame_published_mutex_);
+      frame_published_.wait_for(lock, idle_backoff_, [&]() {
+        return frame_ring_.latest_frame_index() != last_encoded_frame_index;
+      });
     }
+
+    // Clients that wait for a keyframe would wait until the content changes if
+    // no new frame is published (e.g., a static scene with deduplicated
+    // frames), so the latest frame is encoded again for them once per
+    // idle_backoff.
+    const std::uint64_t latest_frame_index = frame_ring_.latest_frame_index();
+    if (latest_frame_index != last_encoded_frame_index ||
+        (latest_frame_index != 0 && encoder->is_keyframe_requested())) {
+      // Frames that are published until the next frame interval starts
+      // replace this one, which makes sure the freshest frame is encoded.
+      std::this_thread::sleep_until(next_encode_time);
+      // If the encoder could not finish the previous frame in time, it
+      // continues from now on instead of trying to catch up.
+      next_encode_time =
+          std::max(next_encode_time, std::chrono::steady_clock::now()) +
+          frame_interval;
+
+      const FrameRing::Reference frame = frame_ring_.AcquireLatest();
+      assert(frame);
+
+      LOGV("Encode frame: ", frame.frame_index());
+      encoder->PushFrame(GetEncoderInput(*encoder, frame), has_missed_deadline);
+      last_encoded_frame_index = frame.frame_index();
+      has_missed_deadline =
+          std::chrono::steady_clock::now() > next_encode_time;
+    } else if (latest_frame_index != 0 && encoder->has_delayed_frames()) {
+      // No frame has been published for idle_backoff, so the frames the
+      // encoder holds back would not show up otherwise
+      const FrameRing::Reference frame = frame_ring_.AcquireLatest();
+      assert(frame);
+      encoder->Flush(GetEncoderInput(*encoder, frame));
+    }
+  }
+}
+
+const FrameBuffer& EncodingPipeline::GetEncoderInput(
+    const Encoder& encoder, const FrameRing::Reference& frame) const {
+  if (!encoder.prefers_i420()) {
+    return frame.frame_buffer();
+  } else if (encoder.preferred_input_width() > 0 &&
+             encoder.preferred_input_height() > 0) {
+    return frame.GetScaledI420FrameBuffer(encoder.preferred_input_width(),
+                                          encoder.preferred_input_height(),
+                                          worker_pool_.get());
+  } else {
+    return frame.GetI420FrameBuffer(worker_pool_.get());
   }
 }
 
@@ -24,4 +24,7 @@
 
 namespace webstreamer {
 
+const std::size_t FrameBuffer::MAX_PLANE_COUNT;
+const std::size_t FrameBuffer::DEFAULT_STRIDE_ALIGNMENT;
+
 }  // namespace webstreamer
@@ -0,0 +1,168 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "webstreamer/frame_copy.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "webstreamer/worker_pool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WEBSTREAMER_FRAME_COPY_SSE2 1
+#include <emmintrin.h>
+#else
+#define WEBSTREAMER_FRAME_COPY_SSE2 0
+#endif
+
+namespace webstreamer {
+
+namespace {
+
+// Below this size the destination most likely still fits into the cache, so
+// regular stores are faster than non-temporal ones.
+const std::size_t NON_TEMPORAL_COPY_THRESHOLD = 8 * 1024 * 1024;
+
+// Splitting smaller copies does not pay off the synchronization overhead.
+const std::size_t PARALLEL_COPY_THRESHOLD = 4 * 1024 * 1024;
+const std::size_t MIN_BYTES_PER_BAND = 1024 * 1024;
+
+#if WEBSTREAMER_FRAME_COPY_SSE2
+void CopyRowNonTemporal(std::uint8_t* destination, const std::uint8_t* source,
+                        std::size_t size) {
+  // Streaming stores require an aligned destination
+  const std::size_t head_size = std::min(
+      size, (16 - (reinterpret_cast<std::uintptr_t>(destination) & 15)) & 15);
+  std::memcpy(destination, source, head_size);
+  destination += head_size;
+  source += head_size;
+  size -= head_size;
+
+  for (; size >= 64; size -= 64, destination += 64, source += 64) {
+    const __m128i a =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+    const __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 16));
+    const __m128i c =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 32));
+    const __m128i d =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 48));
+    _mm_stream_si128(reinterpret_cast<__m128i*>(destination), a);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(destination + 16), b);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(destination + 32), c);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(destination + 48), d);
+  }
+  for (; size >= 16; size -= 16, destination += 16, source += 16) {
+    _mm_stream_si128(
+        reinterpret_cast<__m128i*>(destination),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(source)));
+  }
+  std::memcpy(destination, source, size);
+}
+#endif
+
+void CopyBand(std::uint8_t* destination, std::ptrdiff_t destination_stride,
+              const std::uint8_t* source, std::size_t source_stride,
+              std::size_t row_size, std::size_t row_count,
+              bool non_temporal) {
+#if WEBSTREAMER_FRAME_COPY_SSE2
+  if (non_temporal) {
+    for (std::size_t row = 0; row < row_count; ++row) {
+      CopyRowNonTemporal(destination, source, row_size);
+      destination += destination_stride;
+      source += source_stride;
+    }
+    // Make the streaming stores visible before the band is reported finished
+    _mm_sfence();
+    return;
+  }
+#else
+  (void)non_temporal;
+#endif
+
+  for (std::size_t row = 0; row < row_count; ++row) {
+    std::memcpy(destination, source, row_size);
+    destination += destination_stride;
+    source += source_stride;
+  }
+}
+
+}  // namespace
+
+void CopyRows(void* destination, std::size_t destination_stride,
+              const void* source, std::size_t source_stride,
+              std::size_t row_size, std::size_t row_count,
+              bool flip_vertically, WorkerPool* worker_pool) {
+  if (row_count == 0 || row_size == 0) {
+    return;
+  }
+
+  auto destination_bytes = static_cast<std::uint8_t*>(destination);
+  auto source_bytes = static_cast<const std::uint8_t*>(source);
+  const std::size_t total_size = row_size * row_count;
+
+  if (!flip_vertically && destination_stride == row_size &&
+      source_stride == row_size && total_size < NON_TEMPORAL_COPY_THRESHOLD) {
+    std::memcpy(destination_bytes, source_bytes, total_size);
+    return;
+  }
+
+  // When flipping, the destination is traversed bottom-up
+  std::uint8_t* destination_first_row =
+      flip_vertically
+          ? destination_bytes + (row_count - 1) * destination_stride
+          : destination_bytes;
+  const std::ptrdiff_t signed_destination_stride =
+      flip_vertically ? -static_cast<std::ptrdiff_t>(destination_stride)
+                      : static_cast<std::ptrdiff_t>(destination_stride);
+  const bool non_temporal = total_size >= NON_TEMPORAL_COPY_THRESHOLD;
+
+  std::size_t band_count = 1;
+  if (worker_pool != nullptr && total_size >= PARALLEL_COPY_THRESHOLD) {
+    band_count = std::min(
+        {worker_pool->thread_count() + 1, total_size / MIN_BYTES_PER_BAND,
+         row_count});
+  }
+
+  if (band_count <= 1) {
+    CopyBand(destination_first_row, signed_destination_stride, source_bytes,
+             source_stride, row_size, row_count, non_temporal);
+  } else {
+    const std::size_t rows_per_band = (row_count + band_count - 1) / band_count;
+    worker_pool->ParallelFor(band_count, [&](std::size_t band) {
+      const std::size_t first_row = band * rows_per_band;
+      if (first_row >= row_count) {
+        return;
+      }
+      const std::size_t band_row_count =
+          std::min(rows_per_band, row_count - first_row);
+      CopyBand(destination_first_row +
+                   static_cast<std::ptrdiff_t>(first_row) *
+                       signed_destination_stride,
+               signed_destination_stride,
+               source_bytes + first_row * source_stride, source_stride,
+               row_size, band_row_count, non_temporal);
+    });
+  }
+}
+
+}  // namespace webstreamer
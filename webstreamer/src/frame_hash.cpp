@@ -0,0 +1,227 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "webstreamer/frame_hash.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "webstreamer/frame_buffer.hpp"
+#include "webstreamer/worker_pool.hpp"
+
+namespace webstreamer {
+
+namespace {
+
+// Every band has roughly this size, independent of the worker pool, so the
+// hash of a frame is always the same.
+const std::size_t BYTES_PER_BAND = 1024 * 1024;
+
+// Hashing smaller frames in parallel does not pay off the synchronization
+// overhead.
+const std::size_t PARALLEL_HASH_THRESHOLD = 4 * 1024 * 1024;
+
+const std::uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+const std::uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+const std::uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+const std::uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+const std::uint64_t PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+inline std::uint64_t RotateLeft(std::uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+inline std::uint64_t Read64(const std::uint8_t* data) {
+  std::uint64_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+inline std::uint32_t Read32(const std::uint8_t* data) {
+  std::uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+inline std::uint64_t Round(std::uint64_t accumulator, std::uint64_t input) {
+  accumulator += input * PRIME_2;
+  accumulator = RotateLeft(accumulator, 31);
+  return accumulator * PRIME_1;
+}
+
+inline std::uint64_t MergeRound(std::uint64_t hash, std::uint64_t value) {
+  hash ^= Round(0, value);
+  return hash * PRIME_1 + PRIME_4;
+}
+
+// Incremental XXH64, so rows that are not stored contiguously can be hashed as
+// if they were. The hash is computed with a seed of 0 on little-endian
+// machines.
+class Hasher {
+ public:
+  Hasher()
+      : accumulators_{PRIME_1 + PRIME_2, PRIME_2, 0, 0 - PRIME_1},
+        total_size_(0),
+        buffer_size_(0) {}
+
+  void Update(const std::uint8_t* data, std::size_t size) {
+    total_size_ += size;
+
+    if (buffer_size_ > 0) {
+      const std::size_t fill_size = std::min(size, STRIPE_SIZE - buffer_size_);
+      std::memcpy(buffer_ + buffer_size_, data, fill_size);
+      buffer_size_ += fill_size;
+      data += fill_size;
+      size -= fill_size;
+      if (buffer_size_ < STRIPE_SIZE) {
+        return;
+      }
+      ProcessStripe(buffer_);
+      buffer_size_ = 0;
+    }
+
+    for (; size >= STRIPE_SIZE; size -= STRIPE_SIZE, data += STRIPE_SIZE) {
+      ProcessStripe(data);
+    }
+
+    std::memcpy(buffer_, data, size);
+    buffer_size_ = size;
+  }
+
+  std::uint64_t Digest() const {
+    std::uint64_t hash;
+    if (total_size_ >= STRIPE_SIZE) {
+      hash = RotateLeft(accumulators_[0], 1) +
+             RotateLeft(accumulators_[1], 7) +
+             RotateLeft(accumulators_[2], 12) +
+             RotateLeft(accumulators_[3], 18);
+      for (std::uint64_t accumulator : accumulators_) {
+        hash = MergeRound(hash, accumulator);
+      }
+    } else {
+      hash = accumulators_[2] + PRIME_5;
+    }
+    hash += total_size_;
+
+    const std::uint8_t* data = buffer_;
+    std::size_t size = buffer_size_;
+    for (; size >= 8; size -= 8, data += 8) {
+      hash ^= Round(0, Read64(data));
+      hash = RotateLeft(hash, 27) * PRIME_1 + PRIME_4;
+    }
+    if (size >= 4) {
+      hash ^= Read32(data) * PRIME_1;
+      hash = RotateLeft(hash, 23) * PRIME_2 + PRIME_3;
+      size -= 4;
+      data += 4;
+    }
+    for (; size > 0; --size, ++data) {
+      hash ^= *data * PRIME_5;
+      hash = RotateLeft(hash, 11) * PRIME_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+  }
+
+ private:
+  static const std::size_t STRIPE_SIZE = 32;
+
+  std::uint64_t accumulators_[4];
+  std::uint64_t total_size_;
+  std::uint8_t buffer_[STRIPE_SIZE];
+  std::size_t buffer_size_;
+
+  inline void ProcessStripe(const std::uint8_t* data) {
+    accumulators_[0] = Round(accumulators_[0], Read64(data));
+    accumulators_[1] = Round(accumulators_[1], Read64(data + 8));
+    accumulators_[2] = Round(accumulators_[2], Read64(data + 16));
+    accumulators_[3] = Round(accumulators_[3], Read64(data + 24));
+  }
+};
+
+const std::size_t Hasher::STRIPE_SIZE;
+
+struct Band {
+  const std::uint8_t* data;
+  std::size_t stride;
+  std::size_t row_size;
+  std::size_t row_count;
+};
+
+std::uint64_t HashBand(const Band& band) {
+  Hasher hasher;
+  const std::uint8_t* row = band.data;
+  for (std::size_t i = 0; i < band.row_count; ++i, row += band.stride) {
+    hasher.Update(row, band.row_size);
+  }
+  return hasher.Digest();
+}
+
+}  // namespace
+
+std::uint64_t HashFrame(const FrameBuffer& frame_buffer,
+                        WorkerPool* worker_pool) {
+  std::vector<Band> bands;
+  std::size_t total_size = 0;
+  for (std::size_t plane = 0; plane < frame_buffer.plane_count(); ++plane) {
+    const std::size_t row_size = frame_buffer.GetPlaneRowSize(plane);
+    const std::size_t row_count = frame_buffer.GetPlaneHeight(plane);
+    if (row_size == 0) {
+      continue;
+    }
+    const std::size_t rows_per_band =
+        std::max<std::size_t>(1, BYTES_PER_BAND / row_size);
+    for (std::size_t row = 0; row < row_count; row += rows_per_band) {
+      bands.push_back(
+          {static_cast<const std::uint8_t*>(
+               frame_buffer.GetPlaneRowData(plane, row)),
+           frame_buffer.GetPlaneStride(plane), row_size,
+           std::min(rows_per_band, row_count - row)});
+    }
+    total_size += row_size * row_count;
+  }
+
+  std::vector<std::uint64_t> band_hashes(bands.size());
+  if (worker_pool != nullptr && total_size >= PARALLEL_HASH_THRESHOLD) {
+    worker_pool->ParallelFor(bands.size(), [&](std::size_t band) {
+      band_hashes[band] = HashBand(bands[band]);
+    });
+  } else {
+    for (std::size_t band = 0; band < bands.size(); ++band) {
+      band_hashes[band] = HashBand(bands[band]);
+    }
+  }
+
+  if (band_hashes.size() == 1) {
+    return band_hashes[0];
+  }
+  Hasher hasher;
+  hasher.Update(reinterpret_cast<const std::uint8_t*>(band_hashes.data()),
+                band_hashes.size() * sizeof(std::uint64_t));
+  return hasher.Digest();
+}
+
+}  // namespace webstreamer
@@ -0,0 +1,225 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "webstreamer/frame_ring.hpp"
+#include <algorithm>
+#include <cassert>
+#include <thread>
+#include "log.hpp"
+#include "webstreamer/color_conversion.hpp"
+#include "webstreamer/frame_scaling.hpp"
+
+namespace webstreamer {
+
+const std::uint32_t FrameRing::WRITING;
+const std::size_t FrameRing::NO_SLOT;
+
+FrameRing::FrameRing(std::size_t size, std::size_t stride_alignment,
+                     bool use_huge_pages)
+    : size_(size),
+      slots_(new Slot[size]),
+      latest_slot_(NO_SLOT),
+      latest_frame_index_(0),
+      writing_slot_(NO_SLOT),
+      writing_frame_index_(0) {
+  assert(size >= 2);
+  for (std::size_t i = 0; i < size; ++i) {
+    slots_[i].frame_buffer.SetStrideAlignment(stride_alignment);
+    slots_[i].frame_buffer.SetUseHugePages(use_huge_pages);
+    slots_[i].i420_frame_buffer.SetStrideAlignment(stride_alignment);
+    slots_[i].i420_frame_buffer.SetUseHugePages(use_huge_pages);
+  }
+}
+
+FrameBuffer& FrameRing::BeginWrite() {
+  assert(writing_slot_ == NO_SLOT);
+
+  // Relaxed is fine here, as this is the only thread that writes to that value
+  const std::size_t latest_slot =
+      latest_slot_.load(std::memory_order_relaxed);
+  bool logged_warning = false;
+
+  while (true) {
+    for (std::size_t i = 0; i < size_; ++i) {
+      if (i == latest_slot) {
+        continue;
+      }
+      std::uint32_t expected_reference_count = 0;
+      if (slots_[i].reference_count.compare_exchange_strong(
+              expected_reference_count, WRITING, std::memory_order_acquire,
+              std::memory_order_relaxed)) {
+        writing_slot_ = i;
+        // No consumer holds a reference, so the conversion can be invalidated
+        // without locking.
+        slots_[i].i420_frame_index = 0;
+        for (auto& level : slots_[i].pyramid_levels) {
+          level.second.info().frame_index = 0;
+        }
+        return slots_[i].frame_buffer;
+      }
+    }
+
+    if (!logged_warning) {
+      LOGW("All ", size_, " frame ring slots are in use, increase the size of "
+           "the frame ring to avoid stalling the producer");
+      logged_warning = true;
+    }
+    std::this_thread::yield();
+  }
+}
+
+std::uint64_t FrameRing::Publish() {
+  assert(writing_slot_ != NO_SLOT);
+
+  Slot& slot = slots_[writing_slot_];
+  slot.frame_buffer.info().frame_index = ++writing_frame_index_;
+  slot.reference_count.store(0, std::memory_order_release);
+  latest_slot_.store(writing_slot_, std::memory_order_release);
+  latest_frame_index_.store(writing_frame_index_, std::memory_order_release);
+
+  writing_slot_ = NO_SLOT;
+  return writing_frame_index_;
+}
+
+void FrameRing::CancelWrite() {
+  assert(writing_slot_ != NO_SLOT);
+
+  slots_[writing_slot_].reference_count.store(0, std::memory_order_release);
+  writing_slot_ = NO_SLOT;
+}
+
+const FrameBuffer& FrameRing::Reference::GetI420FrameBuffer(
+    WorkerPool* worker_pool) const {
+  assert(slot_ != nullptr);
+  const FrameBuffer& frame_buffer = slot_->frame_buffer;
+  if (IsPlanar(frame_buffer.pixel_format())) {
+    return frame_buffer;
+  }
+
+  std::lock_guard<std::mutex> lock(slot_->i420_mutex);
+  if (slot_->i420_frame_index != frame_buffer.info().frame_index) {
+    FrameBuffer& i420_frame_buffer = slot_->i420_frame_buffer;
+    i420_frame_buffer.ResizeIfNecessary(
+        frame_buffer.width(), frame_buffer.height(), PixelFormat::I420);
+    std::uint8_t* planes[3];
+    std::size_t strides[3];
+    for (std::size_t i = 0; i < 3; ++i) {
+      planes[i] = static_cast<std::uint8_t*>(i420_frame_buffer.GetPlaneData(i));
+      strides[i] = i420_frame_buffer.GetPlaneStride(i);
+    }
+    ConvertToI420(frame_buffer.GetPlaneData(0), frame_buffer.GetPlaneStride(0),
+                  frame_buffer.pixel_format(), frame_buffer.width(),
+                  frame_buffer.height(), planes, strides, worker_pool);
+    i420_frame_buffer.info() = frame_buffer.info();
+    slot_->i420_frame_index = frame_buffer.info().frame_index;
+  }
+  return slot_->i420_frame_buffer;
+}
+
+const FrameBuffer& FrameRing::Reference::GetScaledI420FrameBuffer(
+    std::size_t width, std::size_t height, WorkerPool* worker_pool) const {
+  const FrameBuffer& i420_frame_buffer = GetI420FrameBuffer(worker_pool);
+  if (i420_frame_buffer.pixel_format() != PixelFormat::I420 ||
+      (i420_frame_buffer.width() == width &&
+       i420_frame_buffer.height() == height)) {
+    return i420_frame_buffer;
+  }
+
+  const std::vector<Size> pyramid_levels = ring_->GetPyramidLevels();
+  std::lock_guard<std::mutex> lock(slot_->pyramid_mutex);
+
+  // Walks down the pyramid, every level that lies between the previous level
+  // and the requested size is derived from the previous level.
+  const FrameBuffer* source = &i420_frame_buffer;
+  for (const Size& level : pyramid_levels) {
+    if (level.first >= width && level.second >= height &&
+        level.first <= source->width() && level.second <= source->height() &&
+        level != Size(width, height) &&
+        level != Size(source->width(), source->height())) {
+      source = &UpdatePyramidLevel(level, *source, worker_pool);
+    }
+  }
+  return UpdatePyramidLevel(Size(width, height), *source, worker_pool);
+}
+
+const FrameBuffer& FrameRing::Reference::UpdatePyramidLevel(
+    const Size& size, const FrameBuffer& source,
+    WorkerPool* worker_pool) const {
+  FrameBuffer& level = slot_->pyramid_levels[size];
+  if (level.info().frame_index != source.info().frame_index ||
+      level.width() != size.first || level.height() != size.second) {
+    level.SetStrideAlignment(slot_->frame_buffer.stride_alignment());
+    level.SetUseHugePages(slot_->frame_buffer.use_huge_pages());
+    level.ResizeIfNecessary(size.first, size.second, PixelFormat::I420);
+    ScaleI420(source, &level, worker_pool);
+    level.info() = source.info();
+  }
+  return level;
+}
+
+FrameRing::Reference FrameRing::AcquireLatest() {
+  while (true) {
+    const std::size_t latest_slot =
+        latest_slot_.load(std::memory_order_acquire);
+    if (latest_slot == NO_SLOT) {
+      return Reference();
+    }
+
+    Slot& slot = slots_[latest_slot];
+    std::uint32_t reference_count =
+        slot.reference_count.load(std::memory_order_relaxed);
+
+    // If the slot is currently being written, a newer frame has been published
+    // in the meantime. Otherwise, the slot contains a completely written frame
+    // (which may even be newer than the one we were looking for).
+    while (reference_count != WRITING) {
+      if (slot.reference_count.compare_exchange_weak(
+              reference_count, reference_count + 1, std::memory_order_acquire,
+              std::memory_order_relaxed)) {
+        return Reference(this, &slot);
+      }
+    }
+  }
+}
+
+void FrameRing::AddPyramidLevel(std::size_t width, std::size_t height) {
+  std::lock_guard<std::mutex> lock(pyramid_levels_mutex_);
+  const Size level(width, height);
+  if (std::find(pyramid_levels_.begin(), pyramid_levels_.end(), level) !=
+      pyramid_levels_.end()) {
+    return;
+  }
+
+  LOGD("Add resolution pyramid level: ", width, "x", height);
+  pyramid_levels_.push_back(level);
+  std::sort(pyramid_levels_.begin(), pyramid_levels_.end(),
+            [](const Size& lhs, const Size& rhs) {
+              return lhs.first * lhs.second > rhs.first * rhs.second;
+            });
+}
+
+std::vector<FrameRing::Size> FrameRing::GetPyramidLevels() const {
+  std::lock_guard<std::mutex> lock(pyramid_levels_mutex_);
+  return pyramid_levels_;
+}
+
+}  // namespace webstreamer
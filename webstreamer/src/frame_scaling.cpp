@@ -0,0 +1,188 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "webstreamer/frame_scaling.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "webstreamer/worker_pool.hpp"
+
+namespace webstreamer {
+
+namespace {
+
+// The weights of the filter taps of each destination pixel add up to
+// 1 << WEIGHT_BITS. The vertically filtered rows are stored with WEIGHT_BITS
+// fractional bits, which fits into 16 bits.
+const int WEIGHT_BITS = 7;
+const int WEIGHT_SUM = 1 << WEIGHT_BITS;
+
+// Smaller slices do not pay off the synchronization overhead
+const std::size_t MIN_ROWS_PER_SLICE = 32;
+
+// The taps of all destination pixels, every pixel uses tap_count consecutive
+// source pixels starting at first_source_indices[i]. Pixels that cover fewer
+// source pixels have zero weights for the remaining taps.
+struct Filter {
+  std::size_t tap_count;
+  std::vector<std::size_t> first_source_indices;
+  std::vector<std::uint16_t> weights;
+};
+
+// Computes the source pixels (and their weights) that each destination pixel
+// covers.
+Filter CalculateFilter(std::size_t source_size, std::size_t destination_size) {
+  const double ratio = static_cast<double>(source_size) /
+                       static_cast<double>(destination_size);
+  Filter filter;
+  filter.tap_count = std::min(
+      source_size, static_cast<std::size_t>(std::ceil(ratio)) + 1);
+  filter.first_source_indices.resize(destination_size);
+  filter.weights.resize(destination_size * filter.tap_count, 0);
+
+  for (std::size_t i = 0; i < destination_size; ++i) {
+    const double begin = static_cast<double>(i) * ratio;
+    const double end = static_cast<double>(i + 1) * ratio;
+    const std::size_t first = static_cast<std::size_t>(begin);
+    const std::size_t last = std::min(
+        source_size - 1, static_cast<std::size_t>(std::ceil(end)) - 1);
+
+    // Moves the taps of the pixels at the end of the row back, so they do not
+    // read past the source row.
+    const std::size_t first_tap =
+        std::min(first, source_size - filter.tap_count);
+    filter.first_source_indices[i] = first_tap;
+    std::uint16_t* const weights = &filter.weights[i * filter.tap_count];
+
+    // The weights are derived from the rounded cumulative coverage, so they
+    // always add up to WEIGHT_SUM.
+    int previous_cumulative_weight = 0;
+    for (std::size_t j = first; j <= last; ++j) {
+      const double covered_end = std::min(end, static_cast<double>(j + 1));
+      const int cumulative_weight =
+          j == last ? WEIGHT_SUM
+                    : static_cast<int>(std::lround((covered_end - begin) /
+                                                   ratio * WEIGHT_SUM));
+      weights[j - first_tap] = static_cast<std::uint16_t>(
+          cumulative_weight - previous_cumulative_weight);
+      previous_cumulative_weight = cumulative_weight;
+    }
+  }
+  return filter;
+}
+
+void ScalePlane(const std::uint8_t* source, std::size_t source_stride,
+                std::size_t source_width, std::size_t source_height,
+                std::uint8_t* destination, std::size_t destination_stride,
+                std::size_t destination_width, std::size_t destination_height,
+                WorkerPool* worker_pool) {
+  const Filter horizontal_filter =
+      CalculateFilter(source_width, destination_width);
+  const Filter vertical_filter =
+      CalculateFilter(source_height, destination_height);
+
+  auto scale_rows = [&](std::size_t first_row, std::size_t end_row) {
+    std::vector<std::uint16_t> filtered_row(source_width);
+    std::uint16_t* const filtered_pixels = filtered_row.data();
+    for (std::size_t y = first_row; y < end_row; ++y) {
+      // Filters the source rows vertically first, which touches the source
+      // pixels in memory order and only has to be done once per destination
+      // row.
+      const std::uint8_t* const first_source_row =
+          source + vertical_filter.first_source_indices[y] * source_stride;
+      const std::uint16_t* const vertical_weights =
+          &vertical_filter.weights[y * vertical_filter.tap_count];
+      std::fill(filtered_row.begin(), filtered_row.end(), 0);
+      for (std::size_t i = 0; i < vertical_filter.tap_count; ++i) {
+        const std::uint16_t weight = vertical_weights[i];
+        if (weight == 0) {
+          continue;
+        }
+        const std::uint8_t* const source_row =
+            first_source_row + i * source_stride;
+        for (std::size_t x = 0; x < source_width; ++x) {
+          filtered_pixels[x] = static_cast<std::uint16_t>(
+              filtered_pixels[x] + source_row[x] * weight);
+        }
+      }
+
+      std::uint8_t* const destination_row =
+          destination + y * destination_stride;
+      for (std::size_t x = 0; x < destination_width; ++x) {
+        const std::uint16_t* const pixels =
+            filtered_pixels + horizontal_filter.first_source_indices[x];
+        const std::uint16_t* const horizontal_weights =
+            &horizontal_filter.weights[x * horizontal_filter.tap_count];
+        std::uint32_t sum = 0;
+        for (std::size_t i = 0; i < horizontal_filter.tap_count; ++i) {
+          sum += static_cast<std::uint32_t>(pixels[i]) * horizontal_weights[i];
+        }
+        destination_row[x] = static_cast<std::uint8_t>(
+            (sum + (1 << (2 * WEIGHT_BITS - 1))) >> (2 * WEIGHT_BITS));
+      }
+    }
+  };
+
+  std::size_t slice_count = 1;
+  if (worker_pool != nullptr) {
+    slice_count = std::min(worker_pool->thread_count() + 1,
+                           destination_height / MIN_ROWS_PER_SLICE);
+  }
+
+  if (slice_count <= 1) {
+    scale_rows(0, destination_height);
+  } else {
+    const std::size_t rows_per_slice = destination_height / slice_count;
+    worker_pool->ParallelFor(slice_count, [&](std::size_t slice) {
+      const std::size_t first_row = slice * rows_per_slice;
+      scale_rows(first_row, slice + 1 == slice_count
+                                ? destination_height
+                                : first_row + rows_per_slice);
+    });
+  }
+}
+
+}  // namespace
+
+void ScaleI420(const FrameBuffer& source, FrameBuffer* destination,
+               WorkerPool* worker_pool) {
+  assert(source.pixel_format() == PixelFormat::I420);
+  assert(destination->pixel_format() == PixelFormat::I420);
+  if (source.width() == 0 || source.height() == 0 ||
+      destination->width() == 0 || destination->height() == 0) {
+    return;
+  }
+
+  for (std::size_t plane = 0; plane < 3; ++plane) {
+    ScalePlane(static_cast<const std::uint8_t*>(source.GetPlaneData(plane)),
+               source.GetPlaneStride(plane), source.GetPlaneRowSize(plane),
+               source.GetPlaneHeight(plane),
+               static_cast<std::uint8_t*>(destination->GetPlaneData(plane)),
+               destination->GetPlaneStride(plane),
+               destination->GetPlaneRowSize(plane),
+               destination->GetPlaneHeight(plane), worker_pool);
+  }
+}
+
+}  // namespace webstreamer
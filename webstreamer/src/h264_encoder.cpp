@@ -21,33 +21,44 @@
 //------------------------------------------------------------------------------
 
 #include "webstreamer/h264_encoder.hpp"
+#include <algorithm>
 #include <iostream>
+#include <iterator>
+#include "av_pixel_format.hpp"
 #include "log.hpp"
+#include "webstreamer/h264_nal_units.hpp"
 #include "webstreamer/stop_watch.hpp"
+#include "webstreamer/worker_pool.hpp"
 
 namespace webstreamer {
 
 namespace {
 
-struct EncodedFrameInfo {
-  std::uint32_t frame_index;
-  std::uint16_t resolution_width;
-  std::uint16_t resolution_height;
-};
-static_assert(sizeof(EncodedFrameInfo) == 8, "");
+// Smaller slices do not pay off the synchronization overhead
+const int MIN_ROWS_PER_SCALING_SLICE = 64;
 
 }  // namespace
 
-H264Encoder::H264Encoder(int width, int height, int framerate, int bitrate)
+H264Encoder::H264Encoder(int width, int height, int framerate, int bitrate,
+                         ColorConverter color_converter,
+                         const H264ThreadingOptions& threading_options,
+                         const H264RateControlOptions& rate_control_options)
     : input_width_(0),
       input_height_(0),
+      input_pixel_format_(PixelFormat::RGB),
       output_width_(width),
       output_height_(height),
       framerate_(framerate),
       bitrate_(bitrate),
+      color_converter_(color_converter),
+      threading_options_(threading_options),
+      rate_control_options_(rate_control_options),
       needs_reset_(true),
       encoder_(nullptr),
-      sws_context_(nullptr) {}
+      next_timestamp_(0) {
+  x264_picture_init(&passthrough_picture_);
+  x264_picture_init(&encoder_output_picture_);
+}
 
 H264Encoder::~H264Encoder() {
   if (encoder_ != nullptr) {
@@ -55,26 +66,59 @@ H264Encoder::~H264Encoder() {
     x264_picture_clean(&encoder_input_picture_);
   }
 
-  sws_freeContext(sws_context_);
+  for (const ScalingSlice& slice : scaling_slices_) {
+    sws_freeContext(slice.sws_context);
+  }
 }
 
 bool H264Encoder::IsCompatible(const CodecOptions& options) {
   return options.optValue<int>("width", output_width_) == output_width_ &&
          options.optValue<int>("height", output_height_) == output_height_ &&
          options.optValue<int>("framerate", framerate_) == framerate_ &&
-         options.optValue<int>("bitrate", bitrate_) == bitrate_;
+         options.optValue<int>("bitrate", bitrate_) == bitrate_ &&
+         options.optValue<int>("threads", threading_options_.thread_count) ==
+             threading_options_.thread_count &&
+         options.optValue<bool>("slicedThreads",
+                                threading_options_.sliced_threads) ==
+             threading_options_.sliced_threads &&
+         options.optValue<int>("sliceCount", threading_options_.slice_count) ==
+             threading_options_.slice_count &&
+         options.optValue<int>("lookahead", threading_options_.lookahead) ==
+             threading_options_.lookahead &&
+         options.optValue<bool>("streamSlices",
+                                threading_options_.stream_slices) ==
+             threading_options_.stream_slices;
 }
 
 void H264Encoder::Reset() {
   x264_param_default_preset(&encoder_parameters_, "ultrafast", "zerolatency");
   encoder_parameters_.i_width = output_width_;
   encoder_parameters_.i_height = output_height_;
-  encoder_parameters_.rc.i_rc_method = X264_RC_ABR;
-  encoder_parameters_.rc.i_bitrate = bitrate_;
+  ApplyRateControlOptions();
   encoder_parameters_.i_fps_num = framerate_;
   encoder_parameters_.i_fps_den = 1;
   encoder_parameters_.b_annexb = 1;
   encoder_parameters_.analyse.i_weighted_pred = X264_WEIGHTP_NONE;
+  encoder_parameters_.i_threads = threading_options_.thread_count;
+  encoder_parameters_.b_sliced_threads =
+      threading_options_.sliced_threads ? 1 : 0;
+  encoder_parameters_.i_slice_count = threading_options_.slice_count;
+  encoder_parameters_.rc.i_lookahead = threading_options_.lookahead;
+  if (threading_options_.stream_slices) {
+    // x264 cannot stream NAL units with frame-based threading
+    if (threading_options_.thread_count > 1 &&
+        !threading_options_.sliced_threads) {
+      LOGW("Streaming slices requires sliced threads, enabling them");
+      encoder_parameters_.b_sliced_threads = 1;
+    }
+    // Streamed slices are sent with the frame that is being pushed, so x264
+    // must not delay its output
+    if (threading_options_.lookahead > 0) {
+      LOGW("Streaming slices does not support a lookahead, disabling it");
+      encoder_parameters_.rc.i_lookahead = 0;
+    }
+    encoder_parameters_.nalu_process = &H264Encoder::ProcessNal;
+  }
   x264_param_apply_fastfirstpass(&encoder_parameters_);
   x264_param_apply_profile(&encoder_parameters_, "baseline");
 
@@ -97,32 +141,143 @@ void H264Encoder::Reset() {
     LOGE("Failed to allocate picture");
   }
 
-  if (!sws_isSupportedInput(AV_PIX_FMT_RGB24)) {
-    LOGE("Invalid input format: RGB24");
+  ResetScalingSlices();
+
+  needs_reset_ = false;
+}
+
+void H264Encoder::ApplyRateControlOptions() {
+  int vbv_max_bitrate = rate_control_options_.vbv_max_bitrate;
+  switch (rate_control_options_.method) {
+    case H264RateControl::ABR:
+      encoder_parameters_.rc.i_rc_method = X264_RC_ABR;
+      encoder_parameters_.rc.i_bitrate = bitrate_;
+      break;
+
+    case H264RateControl::CBR:
+      encoder_parameters_.rc.i_rc_method = X264_RC_ABR;
+      encoder_parameters_.rc.i_bitrate = bitrate_;
+      vbv_max_bitrate = bitrate_;
+      break;
+
+    case H264RateControl::CRF:
+      encoder_parameters_.rc.i_rc_method = X264_RC_CRF;
+      encoder_parameters_.rc.f_rf_constant = rate_control_options_.crf;
+      break;
+  }
+
+  if (rate_control_options_.intra_refresh) {
+    encoder_parameters_.b_intra_refresh = 1;
+    encoder_parameters_.i_keyint_max =
+        rate_control_options_.intra_refresh_period > 0
+            ? rate_control_options_.intra_refresh_period
+            : std::max(1, framerate_);
+  }
+
+  if (vbv_max_bitrate > 0) {
+    encoder_parameters_.rc.i_vbv_max_bitrate = vbv_max_bitrate;
+    encoder_parameters_.rc.i_vbv_buffer_size =
+        rate_control_options_.vbv_buffer_size > 0
+            ? rate_control_options_.vbv_buffer_size
+            : std::max(1, vbv_max_bitrate / std::max(1, framerate_));
+  }
+}
+
+void H264Encoder::ResetScalingSlices() {
+  const AVPixelFormat input_format = GetAVPixelFormat(input_pixel_format_);
+  if (!sws_isSupportedInput(input_format)) {
+    LOGE("Invalid input format: ", static_cast<int>(input_format));
   }
 
   if (!sws_isSupportedOutput(AV_PIX_FMT_YUV420P)) {
     LOGE("Invalid output format: YUV420P");
   }
 
-  sws_context_ =
-      sws_getCachedContext(sws_context_, input_width_, input_height_,
-                           AV_PIX_FMT_RGB24, output_width_, output_height_,
-                           AV_PIX_FMT_YUV420P, 0, nullptr, nullptr, nullptr);
+  int slice_count = 1;
+  if (worker_pool() != nullptr) {
+    slice_count = std::max(
+        1, std::min({static_cast<int>(worker_pool()->thread_count()) + 1,
+                     input_height_ / MIN_ROWS_PER_SCALING_SLICE,
+                     output_height_ / MIN_ROWS_PER_SCALING_SLICE}));
+  }
+  for (std::size_t i = static_cast<std::size_t>(slice_count);
+       i < scaling_slices_.size(); ++i) {
+    sws_freeContext(scaling_slices_[i].sws_context);
+  }
+  scaling_slices_.resize(static_cast<std::size_t>(slice_count),
+                         ScalingSlice{nullptr, 0, 0, 0, 0});
+
+  // The slices start at even rows, so the subsampled chroma rows of the input
+  // and the output are not shared between slices. Each slice is scaled
+  // independently, so the rows at the slice borders may differ slightly from
+  // scaling the frame as a whole.
+  auto get_output_border = [&](int slice) {
+    return slice == slice_count
+               ? output_height_
+               : output_height_ * slice / slice_count / 2 * 2;
+  };
+  auto get_input_border = [&](int slice) {
+    return slice == slice_count
+               ? input_height_
+               : static_cast<int>(
+                     static_cast<std::int64_t>(get_output_border(slice)) *
+                     input_height_ / output_height_ / 2 * 2);
+  };
+  for (int i = 0; i < slice_count; ++i) {
+    ScalingSlice& slice = scaling_slices_[static_cast<std::size_t>(i)];
+    slice.first_input_row = get_input_border(i);
+    slice.input_row_count = get_input_border(i + 1) - slice.first_input_row;
+    slice.first_output_row = get_output_border(i);
+    slice.output_row_count = get_output_border(i + 1) - slice.first_output_row;
 
-  if (!sws_context_) {
-    LOGE("Failed to initialize sws context");
+    slice.sws_context = sws_getCachedContext(
+        slice.sws_context, input_width_, slice.input_row_count, input_format,
+        output_width_, slice.output_row_count, AV_PIX_FMT_YUV420P, 0, nullptr,
+        nullptr, nullptr);
+    if (!slice.sws_context) {
+      LOGE("Failed to initialize sws context");
+    }
   }
+}
 
-  needs_reset_ = false;
+void H264Encoder::ScaleSlice(const FrameBuffer& frame_buffer,
+                             std::size_t slice_index) {
+  const ScalingSlice& slice = scaling_slices_[slice_index];
+
+  const std::uint8_t* src_slice[FrameBuffer::MAX_PLANE_COUNT + 1] = {nullptr};
+  int src_stride[FrameBuffer::MAX_PLANE_COUNT + 1] = {0};
+  for (std::size_t i = 0; i < frame_buffer.plane_count(); ++i) {
+    const int first_row =
+        i == 0 ? slice.first_input_row : slice.first_input_row / 2;
+    src_slice[i] = static_cast<const std::uint8_t*>(
+        frame_buffer.GetPlaneRowData(i, static_cast<std::size_t>(first_row)));
+    src_stride[i] = static_cast<int>(frame_buffer.GetPlaneStride(i));
+  }
+
+  std::uint8_t* dst_slice[3];
+  for (int i = 0; i < 3; ++i) {
+    const int first_row =
+        i == 0 ? slice.first_output_row : slice.first_output_row / 2;
+    dst_slice[i] = encoder_input_picture_.img.plane[i] +
+                   first_row * encoder_input_picture_.img.i_stride[i];
+  }
+
+  const int dst_height =
+      sws_scale(slice.sws_context, src_slice, src_stride, 0,
+                slice.input_row_count, dst_slice,
+                encoder_input_picture_.img.i_stride);
+
+  if (dst_height != slice.output_row_count) {
+    LOGW("Invalid height");
+  }
 }
 
-EncodedFrame H264Encoder::EncodeFrame(const FrameBuffer& frame_buffer) {
+EncodedFrame H264Encoder::EncodeFrame(
+    const FrameBuffer& frame_buffer,
+    std::vector<std::uint8_t>* serialized_frame) {
   EncodedFrame encoded_frame;
   encoded_frame.width = 0;
   encoded_frame.height = 0;
-  encoded_frame.size_in_bytes = 0;
-  encoded_frame.data = nullptr;
 
   if (frame_buffer.width() == 0 || frame_buffer.height() == 0) {
     LOGW("Invalid frame dimensions: ", frame_buffer.width(), "x",
@@ -131,49 +286,166 @@ EncodedFrame H264Encoder::EncodeFrame(const FrameBuffer& frame_buffer) {
   }
 
   if (frame_buffer.width() != static_cast<std::size_t>(input_width_) ||
-      frame_buffer.height() != static_cast<std::size_t>(input_height_)) {
+      frame_buffer.height() != static_cast<std::size_t>(input_height_) ||
+      frame_buffer.pixel_format() != input_pixel_format_) {
     input_width_ = static_cast<int>(frame_buffer.width());
     input_height_ = static_cast<int>(frame_buffer.height());
+    input_pixel_format_ = frame_buffer.pixel_format();
     needs_reset_ = true;
   }
   if (needs_reset_) {
     Reset();
   }
-  const std::uint8_t* src_slice[] = {
-      reinterpret_cast<const std::uint8_t*>(frame_buffer.pixel_data()),
-      nullptr};
-  const int src_stride[] = {static_cast<int>(frame_buffer.stride()), 0};
-  const int src_slice_y = 0;
-  const int src_slice_h = static_cast<int>(frame_buffer.height());
 
-  const int dst_height = sws_scale(
-      sws_context_, src_slice, src_stride, src_slice_y, src_slice_h,
-      encoder_input_picture_.img.plane, encoder_input_picture_.img.i_stride);
-  encoder_input_picture_.i_type =
-      has_new_client() ? X264_TYPE_KEYFRAME : X264_TYPE_AUTO;
+  x264_picture_t* input_picture = &encoder_input_picture_;
+  if (IsPlanar(input_pixel_format_) && input_width_ == output_width_ &&
+      input_height_ == output_height_) {
+    // x264 accepts I420 and NV12 directly, so there is no need to convert.
+    passthrough_picture_.img.i_csp = input_pixel_format_ == PixelFormat::I420
+                                         ? X264_CSP_I420
+                                         : X264_CSP_NV12;
+    passthrough_picture_.img.i_plane =
+        static_cast<int>(frame_buffer.plane_count());
+    for (std::size_t i = 0; i < frame_buffer.plane_count(); ++i) {
+      passthrough_picture_.img.plane[i] = const_cast<std::uint8_t*>(
+          static_cast<const std::uint8_t*>(frame_buffer.GetPlaneData(i)));
+      passthrough_picture_.img.i_stride[i] =
+          static_cast<int>(frame_buffer.GetPlaneStride(i));
+    }
+    input_picture = &passthrough_picture_;
+  } else {
+    if (scaling_slices_.size() > 1) {
+      worker_pool()->ParallelFor(
+          scaling_slices_.size(),
+          [&](std::size_t slice) { ScaleSlice(frame_buffer, slice); });
+    } else {
+      ScaleSlice(frame_buffer, 0);
+    }
+  }
+  // With intra refresh, new clients and clients that fell behind wait for the
+  // next refresh wave (see Encoder::is_keyframe_requested())
+  input_picture->i_type =
+      is_keyframe_requested() && !rate_control_options_.intra_refresh
+          ? X264_TYPE_KEYFRAME
+          : X264_TYPE_AUTO;
+  input_picture->opaque = this;
+  // Identifies the frame x264 outputs, which may be an earlier one
+  input_picture->i_pts = next_timestamp_++;
+  frame_indices_[input_picture->i_pts] = frame_buffer.info().frame_index;
 
-  if (dst_height != output_height_) {
-    LOGW("Invalid height");
+  if (threading_options_.stream_slices) {
+    std::lock_guard<std::mutex> lock(streaming_mutex_);
+    pending_slices_.clear();
+    next_macroblock_ = 0;
+    is_streaming_keyframe_ = false;
+    macroblock_count_ =
+        ((output_width_ + 15) / 16) * ((output_height_ + 15) / 16);
   }
 
   x264_nal_t* nals;
   int nal_count;
-  if (x264_encoder_encode(encoder_, &nals, &nal_count, &encoder_input_picture_,
+  if (x264_encoder_encode(encoder_, &nals, &nal_count, input_picture,
                           &encoder_output_picture_) < 0) {
     LOGW("Failed to encode frame");
+  } else if (threading_options_.stream_slices) {
+    // x264 does not return valid NAL units when streaming, all of them have
+    // been sent already. Slices that are still pending (e.g., because x264
+    // skipped macroblocks) are sent in order.
+    std::lock_guard<std::mutex> lock(streaming_mutex_);
+    SendPendingSlices(true);
+    // Streamed frames are not delayed
+    frame_indices_.clear();
   } else {
-    buffer_.clear();
-    for (int i = 0; i < nal_count; ++i) {
-      buffer_.insert(buffer_.end(), nals[i].p_payload,
-                     nals[i].p_payload + nals[i].i_payload);
-    }
-    encoded_frame.width = output_width_;
-    encoded_frame.height = output_height_;
-    encoded_frame.data = buffer_.data();
-    encoded_frame.size_in_bytes = buffer_.size();
+    encoded_frame = AppendNals(nals, nal_count, serialized_frame);
+  }
+
+  return encoded_frame;
+}
+
+bool H264Encoder::has_delayed_frames() {
+  return encoder_ != nullptr && x264_encoder_delayed_frames(encoder_) > 0;
+}
+
+EncodedFrame H264Encoder::AppendNals(
+    const x264_nal_t* nals, int nal_count,
+    std::vector<std::uint8_t>* serialized_frame) {
+  EncodedFrame encoded_frame;
+  // x264 returns no NAL units while it delays the frame
+  if (nal_count == 0) {
+    return encoded_frame;
   }
 
+  // The payloads of all NAL units are contiguous, so they can be copied at
+  // once.
+  std::size_t size_in_bytes = 0;
+  for (int i = 0; i < nal_count; ++i) {
+    size_in_bytes += static_cast<std::size_t>(nals[i].i_payload);
+  }
+  const std::size_t payload_offset = serialized_frame->size();
+  serialized_frame->insert(serialized_frame->end(), nals[0].p_payload,
+                           nals[0].p_payload + size_in_bytes);
+  encoded_frame.width = static_cast<std::size_t>(output_width_);
+  encoded_frame.height = static_cast<std::size_t>(output_height_);
+  // Timestamps of frames x264 failed to encode are never returned
+  const auto frame_index = frame_indices_.find(encoder_output_picture_.i_pts);
+  if (frame_index != frame_indices_.end()) {
+    encoded_frame.frame_index = frame_index->second;
+    frame_indices_.erase(frame_indices_.begin(), std::next(frame_index));
+  }
+  encoded_frame.is_keyframe = encoder_output_picture_.b_keyframe != 0;
+  encoded_frame.is_reference = !IsH264NonReferenceFrame(
+      serialized_frame->data() + payload_offset, size_in_bytes);
   return encoded_frame;
 }
 
+void H264Encoder::ProcessNal(x264_t* encoder, x264_nal_t* nal, void* opaque) {
+  // Called by the x264 threads, see x264_param_t::nalu_process
+  std::vector<std::uint8_t> data(
+      static_cast<std::size_t>(nal->i_payload) * 3 / 2 + 5 + 64);
+  x264_nal_encode(encoder, data.data(), nal);
+  data.resize(static_cast<std::size_t>(nal->i_payload));
+  static_cast<H264Encoder*>(opaque)->SendNal(*nal, std::move(data));
+}
+
+void H264Encoder::SendNal(const x264_nal_t& nal,
+                          std::vector<std::uint8_t> data) {
+  std::lock_guard<std::mutex> lock(streaming_mutex_);
+  // x264 repeats the parameter sets in front of every keyframe (including the
+  // start of an intra refresh wave)
+  if (nal.i_type == NAL_SPS || nal.i_type == NAL_SLICE_IDR) {
+    is_streaming_keyframe_ = true;
+  }
+
+  if (nal.i_type != NAL_SLICE && nal.i_type != NAL_SLICE_IDR) {
+    // Parameter sets and SEI are written before the slices
+    SendEncodedFramePart(static_cast<std::size_t>(output_width_),
+                         static_cast<std::size_t>(output_height_),
+                         data.data(), data.size(), is_streaming_keyframe_,
+                         true, false);
+  } else {
+    pending_slices_[nal.i_first_mb] =
+        PendingSlice{nal.i_last_mb, std::move(data)};
+    SendPendingSlices(false);
+  }
+}
+
+void H264Encoder::SendPendingSlices(bool flush) {
+  while (!pending_slices_.empty() &&
+         (flush || pending_slices_.begin()->first == next_macroblock_)) {
+    const auto slice = pending_slices_.begin();
+    next_macroblock_ = slice->second.last_macroblock + 1;
+    const bool is_last_part =
+        next_macroblock_ >= macroblock_count_ ||
+        (flush && pending_slices_.size() == 1);
+    SendEncodedFramePart(static_cast<std::size_t>(output_width_),
+                         static_cast<std::size_t>(output_height_),
+                         slice->second.data.data(), slice->second.data.size(),
+                         is_streaming_keyframe_,
+                         !IsH264NonReferenceFrame(slice->second.data.data(),
+                                                  slice->second.data.size()),
+                         is_last_part);
+    pending_slices_.erase(slice);
+  }
+}
+
 }  // namespace webstreamer
@@ -1,12 +1,24 @@
 #include "webstreamer/h264_encoder_factory.hpp"
+#include <algorithm>
+#include <thread>
+#include "log.hpp"
 #include "webstreamer/h264_encoder.hpp"
 
 namespace webstreamer {
 
+namespace {
+
+// In kbit/s
+const int DEFAULT_BITRATE = 6000;
+
+}  // namespace
+
 H264EncoderFactory::H264EncoderFactory(
     const Poco::Util::JSONConfiguration* configuration,
     Poco::Util::JSONConfiguration* stream_config)
-    : configuration_(configuration), stream_config_(stream_config) {
+    : configuration_(configuration),
+      stream_config_(stream_config),
+      display_mode_count_(0) {
   if (configuration->getBool("codecs.h264.enabled")) {
     stream_config_->setBool("codecs.h264.supported", true);
 
@@ -28,15 +40,139 @@ H264EncoderFactory::H264EncoderFactory(
       stream_config->setInt(
           stream_config_key + ".framerate",
           configuration->getInt(configuration_key + ".framerate"));
+      ++display_mode_count_;
     }
   }
 }
 
 std::unique_ptr<Encoder> H264EncoderFactory::CreateEncoder(
     const Poco::JSON::Object& options) {
+  const ColorConverter color_converter =
+      configuration_->getString("codecs.h264.colorConverter", "builtin") ==
+              "swscale"
+          ? ColorConverter::SWSCALE
+          : ColorConverter::BUILTIN;
+
+  // By default, the cores are split evenly between the encoders of all
+  // display modes, as every display mode is usually watched by someone.
+  const int core_count =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  const int default_thread_count =
+      std::max(1, core_count / std::max(1, display_mode_count_));
+
+  const std::string display_mode = FindDisplayMode(options);
+  H264ThreadingOptions threading_options;
+  threading_options.thread_count = std::max(
+      1, options.optValue<int>(
+             "threads",
+             GetIntSetting(display_mode, "threads", default_thread_count)));
+  threading_options.sliced_threads = options.optValue<bool>(
+      "slicedThreads",
+      GetBoolSetting(display_mode, "slicedThreads",
+                     threading_options.sliced_threads));
+  threading_options.slice_count = std::max(
+      0, options.optValue<int>(
+             "sliceCount", GetIntSetting(display_mode, "sliceCount",
+                                         threading_options.slice_count)));
+  threading_options.lookahead = std::max(
+      0, options.optValue<int>(
+             "lookahead", GetIntSetting(display_mode, "lookahead",
+                                        threading_options.lookahead)));
+  threading_options.stream_slices = options.optValue<bool>(
+      "streamSlices", GetBoolSetting(display_mode, "streamSlices",
+                                     threading_options.stream_slices));
+
+  const int bitrate = options.optValue<int>(
+      "bitrate", GetIntSetting(display_mode, "bitrate", DEFAULT_BITRATE));
+
+  H264RateControlOptions rate_control_options;
+  const std::string rate_control =
+      GetStringSetting(display_mode, "rateControl", "abr");
+  if (rate_control == "cbr") {
+    rate_control_options.method = H264RateControl::CBR;
+  } else if (rate_control == "crf") {
+    rate_control_options.method = H264RateControl::CRF;
+  } else if (rate_control != "abr") {
+    LOGW("Unknown rate control: ", rate_control, ", falling back to ABR");
+  }
+  rate_control_options.crf = static_cast<float>(GetDoubleSetting(
+      display_mode, "crf", static_cast<double>(rate_control_options.crf)));
+  rate_control_options.vbv_max_bitrate = std::max(
+      0, GetIntSetting(display_mode, "vbvMaxrate",
+                       rate_control_options.vbv_max_bitrate));
+  rate_control_options.vbv_buffer_size = std::max(
+      0, GetIntSetting(display_mode, "vbvBufsize",
+                       rate_control_options.vbv_buffer_size));
+
+  rate_control_options.intra_refresh = GetBoolSetting(
+      display_mode, "intraRefresh", rate_control_options.intra_refresh);
+  rate_control_options.intra_refresh_period = std::max(
+      0, GetIntSetting(display_mode, "intraRefreshPeriod",
+                       rate_control_options.intra_refresh_period));
+
   return std::make_unique<H264Encoder>(
       options.getValue<int>("width"), options.getValue<int>("height"),
-      options.getValue<int>("framerate"), 6000);
+      options.getValue<int>("framerate"), bitrate, color_converter,
+      threading_options, rate_control_options);
+}
+
+std::string H264EncoderFactory::FindDisplayMode(
+    const Poco::JSON::Object& options) const {
+  for (int i = 0; i < display_mode_count_; ++i) {
+    const std::string key =
+        "codecs.h264.displayModes[" + std::to_string(i) + "]";
+    if (configuration_->getInt(key + ".width") ==
+            options.getValue<int>("width") &&
+        configuration_->getInt(key + ".height") ==
+            options.getValue<int>("height") &&
+        configuration_->getInt(key + ".framerate") ==
+            options.getValue<int>("framerate")) {
+      return key;
+    }
+  }
+  return "";
+}
+
+int H264EncoderFactory::GetIntSetting(const std::string& display_mode,
+                                      const std::string& name,
+                                      int default_value) const {
+  const int codec_value =
+      configuration_->getInt("codecs.h264." + name, default_value);
+  return display_mode.empty()
+             ? codec_value
+             : configuration_->getInt(display_mode + "." + name, codec_value);
+}
+
+bool H264EncoderFactory::GetBoolSetting(const std::string& display_mode,
+                                        const std::string& name,
+                                        bool default_value) const {
+  const bool codec_value =
+      configuration_->getBool("codecs.h264." + name, default_value);
+  return display_mode.empty()
+             ? codec_value
+             : configuration_->getBool(display_mode + "." + name, codec_value);
+}
+
+double H264EncoderFactory::GetDoubleSetting(const std::string& display_mode,
+                                            const std::string& name,
+                                            double default_value) const {
+  const double codec_value =
+      configuration_->getDouble("codecs.h264." + name, default_value);
+  return display_mode.empty()
+             ? codec_value
+             : configuration_->getDouble(display_mode + "." + name,
+                                         codec_value);
+}
+
+std::string H264EncoderFactory::GetStringSetting(
+    const std::string& display_mode, const std::string& name,
+    const std::string& default_value) const {
+  const std::string codec_value =
+      configuration_->getString("codecs.h264." + name, default_value);
+  return display_mode.empty()
+             ? codec_value
+             : configuration_->getString(display_mode + "." + name,
+                                         codec_value);
 }
 
 }  // namespace webstreamer
@@ -0,0 +1,86 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "webstreamer/h264_nal_units.hpp"
+
+namespace webstreamer {
+
+namespace {
+
+// Returns the offset of the first byte after the next start code (00 00 01,
+// the 4 byte start code ends with the same bytes) or size_in_bytes.
+std::size_t FindNextNalUnit(const std::uint8_t* data, std::size_t size_in_bytes,
+                            std::size_t offset) {
+  for (std::size_t i = offset; i + 3 <= size_in_bytes; ++i) {
+    if (data[i + 2] > 1) {
+      // None of the next three positions can end a start code before i + 3
+      i += 2;
+    } else if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+      return i + 3;
+    }
+  }
+  return size_in_bytes;
+}
+
+}  // namespace
+
+std::vector<H264NalUnit> ParseH264NalUnits(const std::uint8_t* data,
+                                           std::size_t size_in_bytes) {
+  std::vector<H264NalUnit> nal_units;
+  std::size_t start = FindNextNalUnit(data, size_in_bytes, 0);
+  while (start < size_in_bytes) {
+    const std::size_t next_start = FindNextNalUnit(data, size_in_bytes, start);
+    std::size_t end = next_start;
+    if (next_start < size_in_bytes) {
+      // Exclude the next start code and the zero bytes in front of it
+      end -= 3;
+      while (end > start && data[end - 1] == 0) {
+        --end;
+      }
+    }
+    if (end > start) {
+      nal_units.push_back(H264NalUnit{
+          static_cast<std::uint8_t>((data[start] >> 5) & 0x3),
+          static_cast<std::uint8_t>(data[start] & 0x1f), data + start,
+          end - start});
+    }
+    start = next_start;
+  }
+  return nal_units;
+}
+
+bool IsH264NonReferenceFrame(const std::uint8_t* data,
+                             std::size_t size_in_bytes) {
+  bool contains_slices = false;
+  for (const auto& nal_unit : ParseH264NalUnits(data, size_in_bytes)) {
+    if (nal_unit.type == H264_NAL_SLICE ||
+        nal_unit.type == H264_NAL_SLICE_IDR) {
+      if (nal_unit.ref_idc != 0) {
+        return false;
+      }
+      contains_slices = true;
+    }
+  }
+  return contains_slices;
+}
+
+}  // namespace webstreamer
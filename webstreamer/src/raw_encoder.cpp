@@ -21,22 +21,86 @@
 //------------------------------------------------------------------------------
 
 #include "webstreamer/raw_encoder.hpp"
+#include "av_pixel_format.hpp"
+#include "log.hpp"
 #include "webstreamer/frame_buffer.hpp"
+#include "webstreamer/frame_copy.hpp"
 
 namespace webstreamer {
 
+namespace {
+
+// Lines of raw frames sent to the clients are aligned to 4 byte
+const std::size_t RAW_FRAME_STRIDE_ALIGNMENT = 4;
+
+}  // namespace
+
+RawEncoder::RawEncoder()
+    : sws_context_(nullptr),
+      rgb_frame_buffer_(0, 0, PixelFormat::RGB, RAW_FRAME_STRIDE_ALIGNMENT) {}
+
+RawEncoder::~RawEncoder() { sws_freeContext(sws_context_); }
+
 bool RawEncoder::IsCompatible(const CodecOptions& configuration) {
   (void)configuration;
   return true;
 }
 
-EncodedFrame RawEncoder::EncodeFrame(const FrameBuffer& frame_buffer) {
+EncodedFrame RawEncoder::EncodeFrame(
+    const FrameBuffer& frame_buffer,
+    std::vector<std::uint8_t>* serialized_frame) {
+  const FrameBuffer* rgb_frame_buffer = &frame_buffer;
+
+  if (frame_buffer.pixel_format() == PixelFormat::RGB &&
+      frame_buffer.stride_alignment() != RAW_FRAME_STRIDE_ALIGNMENT) {
+    rgb_frame_buffer_.ResizeIfNecessary(frame_buffer.width(),
+                                        frame_buffer.height());
+    CopyRows(rgb_frame_buffer_.pixel_data(), rgb_frame_buffer_.stride(),
+             frame_buffer.pixel_data(), frame_buffer.stride(),
+             rgb_frame_buffer_.GetPlaneRowSize(0), frame_buffer.height(),
+             false);
+    rgb_frame_buffer = &rgb_frame_buffer_;
+  } else if (frame_buffer.pixel_format() != PixelFormat::RGB) {
+    const int width = static_cast<int>(frame_buffer.width());
+    const int height = static_cast<int>(frame_buffer.height());
+    rgb_frame_buffer_.ResizeIfNecessary(frame_buffer.width(),
+                                        frame_buffer.height());
+    sws_context_ = sws_getCachedContext(
+        sws_context_, width, height,
+        GetAVPixelFormat(frame_buffer.pixel_format()), width, height,
+        AV_PIX_FMT_RGB24, SWS_POINT, nullptr, nullptr, nullptr);
+    if (!sws_context_) {
+      LOGE("Failed to initialize sws context");
+    } else {
+      const std::uint8_t* src_slice[FrameBuffer::MAX_PLANE_COUNT + 1] = {
+          nullptr};
+      int src_stride[FrameBuffer::MAX_PLANE_COUNT + 1] = {0};
+      for (std::size_t i = 0; i < frame_buffer.plane_count(); ++i) {
+        src_slice[i] =
+            static_cast<const std::uint8_t*>(frame_buffer.GetPlaneData(i));
+        src_stride[i] = static_cast<int>(frame_buffer.GetPlaneStride(i));
+      }
+      std::uint8_t* const dst_slice[] = {
+          static_cast<std::uint8_t*>(rgb_frame_buffer_.pixel_data())};
+      const int dst_stride[] = {static_cast<int>(rgb_frame_buffer_.stride())};
+      sws_scale(sws_context_, src_slice, src_stride, 0, height, dst_slice,
+                dst_stride);
+    }
+    rgb_frame_buffer = &rgb_frame_buffer_;
+  }
+
+  const std::uint8_t* const pixel_data =
+      static_cast<const std::uint8_t*>(rgb_frame_buffer->pixel_data());
+  serialized_frame->insert(
+      serialized_frame->end(), pixel_data,
+      pixel_data + rgb_frame_buffer->stride() * rgb_frame_buffer->height());
+
   EncodedFrame encoded_frame;
-  encoded_frame.width = frame_buffer.width();
-  encoded_frame.height = frame_buffer.height();
-  encoded_frame.size_in_bytes = frame_buffer.stride() * frame_buffer.height();
-  encoded_frame.data =
-      reinterpret_cast<const std::uint8_t*>(frame_buffer.pixel_data());
+  encoded_frame.width = rgb_frame_buffer->width();
+  encoded_frame.height = rgb_frame_buffer->height();
+  // Raw frames are decoded independently of each other
+  encoded_frame.is_keyframe = true;
+  encoded_frame.is_reference = false;
   return encoded_frame;
 }
 
@@ -0,0 +1,239 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "webstreamer/shared_memory_ingest.hpp"
+#include <cassert>
+#include "log.hpp"
+#include "webstreamer/encoding_pipeline.hpp"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace webstreamer {
+
+#if defined(__linux__)
+
+SharedMemoryIngest::SharedMemoryIngest(const std::string& name,
+                                       EncodingPipeline* encoding_pipeline,
+                                       std::chrono::milliseconds idle_backoff)
+    : path_(GetSharedFrameRingPath(name)),
+      encoding_pipeline_(encoding_pipeline),
+      idle_backoff_(idle_backoff),
+      header_(nullptr),
+      mapping_size_(0),
+      mapped_inode_(0),
+      last_sequence_(0),
+      stop_(false),
+      ingest_thread_(&SharedMemoryIngest::IngestThread, this) {
+  assert(encoding_pipeline != nullptr);
+}
+
+SharedMemoryIngest::~SharedMemoryIngest() {
+  stop_ = true;
+  ingest_thread_.join();
+  Detach();
+}
+
+bool SharedMemoryIngest::Attach() {
+  const int file_descriptor = shm_open(path_.c_str(), O_RDWR, 0);
+  if (file_descriptor < 0) {
+    return false;
+  }
+
+  struct stat file_status;
+  if (fstat(file_descriptor, &file_status) != 0 ||
+      static_cast<std::size_t>(file_status.st_size) <
+          sizeof(SharedFrameRingHeader)) {
+    close(file_descriptor);
+    return false;
+  }
+
+  const std::size_t mapping_size =
+      static_cast<std::size_t>(file_status.st_size);
+  void* mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, file_descriptor, 0);
+  close(file_descriptor);
+  if (mapping == MAP_FAILED) {
+    LOGE("Failed to map shared memory ", path_);
+    return false;
+  }
+
+  auto header = static_cast<SharedFrameRingHeader*>(mapping);
+  if (header->magic.load(std::memory_order_acquire) !=
+          SHARED_FRAME_RING_MAGIC ||
+      header->version != SHARED_FRAME_RING_VERSION ||
+      GetSharedFrameRingSize(header->slot_count, header->slot_capacity) >
+          mapping_size) {
+    // The producer may still be initializing the segment
+    munmap(mapping, mapping_size);
+    return false;
+  }
+
+  // A previous consumer may have died while it pinned a slot
+  ReleaseSharedFrameRingPins(header);
+
+  header_ = header;
+  mapping_size_ = mapping_size;
+  mapped_inode_ = static_cast<std::uint64_t>(file_status.st_ino);
+  last_sequence_ = header->sequence.load(std::memory_order_acquire);
+  LOGI("Attached to shared memory ", path_, " with ", header->slot_count,
+       " slots");
+
+  // Show the frame the producer published before we attached
+  if (header->latest_slot.load(std::memory_order_acquire) !=
+      SHARED_FRAME_RING_NO_SLOT) {
+    IngestLatestFrame();
+  }
+  return true;
+}
+
+void SharedMemoryIngest::Detach() {
+  if (header_ != nullptr) {
+    munmap(header_, mapping_size_);
+    header_ = nullptr;
+    mapping_size_ = 0;
+    LOGI("Detached from shared memory ", path_);
+  }
+}
+
+bool SharedMemoryIngest::HasProducerRestarted() const {
+  // A restarted producer creates a new segment under the same name
+  struct stat file_status;
+  const int file_descriptor = shm_open(path_.c_str(), O_RDONLY, 0);
+  if (file_descriptor < 0) {
+    return true;
+  }
+  const bool has_restarted =
+      fstat(file_descriptor, &file_status) != 0 ||
+      static_cast<std::uint64_t>(file_status.st_ino) != mapped_inode_;
+  close(file_descriptor);
+  return has_restarted;
+}
+
+void SharedMemoryIngest::IngestLatestFrame() {
+  SharedFrameSlot* const slots = GetSharedFrameSlots(header_);
+
+  // See FrameRing::AcquireLatest()
+  SharedFrameSlot* slot = nullptr;
+  while (slot == nullptr) {
+    const std::uint32_t latest_slot =
+        header_->latest_slot.load(std::memory_order_acquire);
+    if (latest_slot >= header_->slot_count) {
+      return;
+    }
+
+    std::uint32_t reference_count =
+        slots[latest_slot].reference_count.load(std::memory_order_relaxed);
+    while (reference_count != SHARED_FRAME_RING_WRITING) {
+      if (slots[latest_slot].reference_count.compare_exchange_weak(
+              reference_count, reference_count + 1, std::memory_order_acquire,
+              std::memory_order_relaxed)) {
+        slot = &slots[latest_slot];
+        break;
+      }
+    }
+  }
+
+  // The segment is writable by another process, so the fields are read once
+  // and validated before they are used.
+  const std::size_t width = slot->width;
+  const std::size_t height = slot->height;
+  const std::uint32_t pixel_format = slot->pixel_format;
+  const bool flip_vertically = slot->flip_vertically != 0;
+  const std::uint64_t size_in_bytes = slot->size_in_bytes;
+  const std::uint64_t data_offset = slot->data_offset;
+
+  PlaneLayout planes[MAX_PLANE_COUNT];
+  if (pixel_format <= static_cast<std::uint32_t>(PixelFormat::NV12) &&
+      // Rules out overflows when calculating the layout
+      width * height <= mapping_size_ &&
+      CalculateFrameLayout(width, height,
+                           static_cast<PixelFormat>(pixel_format),
+                           PUSH_FRAME_STRIDE_ALIGNMENT,
+                           planes) == size_in_bytes &&
+      data_offset <= mapping_size_ &&
+      size_in_bytes <= mapping_size_ - data_offset) {
+    encoding_pipeline_->PushFrame(
+        width, height,
+        reinterpret_cast<const std::uint8_t*>(header_) + data_offset,
+        static_cast<std::size_t>(size_in_bytes), flip_vertically,
+        static_cast<PixelFormat>(pixel_format));
+  } else {
+    LOGW("Invalid frame in shared memory ", path_);
+  }
+
+  slot->reference_count.fetch_sub(1, std::memory_order_release);
+}
+
+void SharedMemoryIngest::IngestThread() {
+  while (!stop_) {
+    if (header_ == nullptr && !Attach()) {
+      std::this_thread::sleep_for(idle_backoff_);
+      continue;
+    }
+
+    const std::uint32_t sequence =
+        header_->sequence.load(std::memory_order_acquire);
+    if (sequence != last_sequence_) {
+      last_sequence_ = sequence;
+      IngestLatestFrame();
+      continue;
+    }
+
+    header_->consumer_waiting.store(1);
+    const bool was_woken_up = WaitForSharedFrameRingSequence(
+        &header_->sequence, sequence, idle_backoff_);
+    header_->consumer_waiting.store(0);
+
+    if (!was_woken_up &&
+        header_->sequence.load(std::memory_order_acquire) == sequence &&
+        HasProducerRestarted()) {
+      Detach();
+    }
+  }
+}
+
+#else
+
+SharedMemoryIngest::SharedMemoryIngest(const std::string& name,
+                                       EncodingPipeline* encoding_pipeline,
+                                       std::chrono::milliseconds idle_backoff)
+    : path_(GetSharedFrameRingPath(name)),
+      encoding_pipeline_(encoding_pipeline),
+      idle_backoff_(idle_backoff),
+      header_(nullptr),
+      mapping_size_(0),
+      mapped_inode_(0),
+      last_sequence_(0),
+      stop_(true) {
+  LOGE("Shared memory ingest is not supported on this platform");
+}
+
+SharedMemoryIngest::~SharedMemoryIngest() {}
+
+#endif
+
+}  // namespace webstreamer
@@ -25,6 +25,7 @@
 #include "webstreamer/webrtc_stream_client.hpp"
 #include <functional>
 #include "log.hpp"
+#include "webstreamer/encoded_frame_header.hpp"
 #include "webstreamer/encoder.hpp"
 #include "webstreamer/suppress_warnings.hpp"
 SUPPRESS_WARNINGS_BEGIN
@@ -98,6 +99,7 @@ WebRTCStreamClient::WebRTCStreamClient(
 }
 
 WebRTCStreamClient::~WebRTCStreamClient() {
+  StopSending();
   event_channel_->UnregisterObserver();
   video_channel_->UnregisterObserver();
   web_socket_.close();
@@ -109,9 +111,14 @@ WebRTCStreamClient::~WebRTCStreamClient() {
 void WebRTCStreamClient::OnFrameEncoded(const EncodedFrame& encoded_frame) {
   LOGV("Try to send ", encoded_frame.size_in_bytes, " bytes");
   if (video_channel_->state() == webrtc::DataChannelInterface::kOpen) {
-    const std::uint32_t frame_size =
-        static_cast<std::uint32_t>(encoded_frame.size_in_bytes);
-    assert(frame_size == encoded_frame.size_in_bytes);
+    // The header is sent as if it was part of the frame data, both are taken
+    // from the serialized frame.
+    const std::uint8_t* const frame_data =
+        encoded_frame.serialized_frame->data() + ENCODED_FRAME_HEADER_OFFSET;
+    const std::uint32_t frame_size = static_cast<std::uint32_t>(
+        encoded_frame.serialized_frame->size() - ENCODED_FRAME_HEADER_OFFSET);
+    assert(frame_size == encoded_frame.serialized_frame->size() -
+                             ENCODED_FRAME_HEADER_OFFSET);
     std::uint32_t bytes_sent = 0;
 
     while (bytes_sent < frame_size) {
@@ -128,9 +135,9 @@ void WebRTCStreamClient::OnFrameEncoded(const EncodedFrame& encoded_frame) {
           sizeof(bytes_sent));
       assert(send_buffer_.size() == MESSAGE_HEADER_SIZE);
 
-      std::uint32_t fragment_size =
+      const std::uint32_t fragment_size =
           std::min(frame_size - bytes_sent, MAX_MESSAGE_CONTENT_SIZE);
-      send_buffer_.AppendData(encoded_frame.data + bytes_sent, fragment_size);
+      send_buffer_.AppendData(frame_data + bytes_sent, fragment_size);
       video_channel_->Send({send_buffer_, true});
       LOGV("Sent ", send_buffer_.size(), " bytes");
       LOGV("Buffered data in video channel: ",
@@ -139,6 +146,8 @@ void WebRTCStreamClient::OnFrameEncoded(const EncodedFrame& encoded_frame) {
       bytes_sent += fragment_size;
     }
     ++message_counter_;
+    set_buffered_amount(
+        static_cast<std::size_t>(video_channel_->buffered_amount()));
   } else {
     LOGE("Failed to send video data: video data channel is not open");
   }
@@ -299,6 +308,16 @@ void WebRTCStreamClient::OnMessage(const webrtc::DataBuffer& buffer) {
   AddEvent(DeserializeEvent(buffer.data.cdata<char>(), buffer.data.size()));
 }
 
+void WebRTCStreamClient::OnBufferedAmountChange(uint64_t previous_amount) {
+  (void)previous_amount;
+  // Both channels share the observer, only the video channel is relevant for
+  // the frame drop policy
+  if (video_channel_ != nullptr) {
+    set_buffered_amount(
+        static_cast<std::size_t>(video_channel_->buffered_amount()));
+  }
+}
+
 void WebRTCStreamClient::ReceiveThread() {
   Poco::Buffer<char> buffer(0);
   int flags;
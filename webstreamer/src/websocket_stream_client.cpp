@@ -22,6 +22,7 @@
 
 #include "webstreamer/websocket_stream_client.hpp"
 #include "log.hpp"
+#include "webstreamer/encoded_frame_header.hpp"
 #include "webstreamer/suppress_warnings.hpp"
 SUPPRESS_WARNINGS_BEGIN
 #include "Poco/Net/NetException.h"
@@ -40,14 +41,20 @@ WebSocketStreamClient::WebSocketStreamClient(Poco::Net::WebSocket web_socket)
 }
 
 WebSocketStreamClient::~WebSocketStreamClient() {
+  StopSending();
   Die();
   receive_thread_.join();
   LOGI("WebSocketStreamClient disconnected: ", address_);
 }
 
 void WebSocketStreamClient::OnFrameEncoded(const EncodedFrame& encoded_frame) {
-  SendData(DataType::ENCODED_FRAME, encoded_frame.data,
-           encoded_frame.size_in_bytes);
+  // The serialized frame already contains the data type and the header
+  static_assert(static_cast<std::uint32_t>(DataType::ENCODED_FRAME) ==
+                    ENCODED_FRAME_MESSAGE_TYPE,
+                "");
+  std::lock_guard<std::mutex> lock(buffer_mutex_);
+  SendBytes(encoded_frame.serialized_frame->data(),
+            encoded_frame.serialized_frame->size());
 }
 
 void WebSocketStreamClient::OnCodecSwitched(Codec codec,
@@ -58,7 +65,7 @@ void WebSocketStreamClient::OnCodecSwitched(Codec codec,
 
 void WebSocketStreamClient::SendEvent(const Event& event) {
   const auto buffer = event.Serialize();
-  SendData(DataType::ENCODED_FRAME, buffer.data(), buffer.size());
+  SendData(DataType::EVENT_DATA, buffer.data(), buffer.size());
 }
 
 void WebSocketStreamClient::SendData(DataType data_type, const void* data,
@@ -67,9 +74,13 @@ void WebSocketStreamClient::SendData(DataType data_type, const void* data,
   buffer_.resize(data_size + 4);
   std::memcpy(buffer_.data(), &data_type, 4);
   std::memcpy(buffer_.data() + 4, data, data_size);
+  SendBytes(buffer_.data(), buffer_.size());
+}
+
+void WebSocketStreamClient::SendBytes(const void* data, std::size_t size) {
   try {
-    const int buffer_size = static_cast<int>(buffer_.size());
-    if (web_socket_.sendBytes(buffer_.data(), buffer_size) != buffer_size) {
+    const int int_size = static_cast<int>(size);
+    if (web_socket_.sendBytes(data, int_size) != int_size) {
       LOGE("Client ", address_, " failed to send bytes");
       Die();
     }
@@ -51,7 +51,14 @@ WebStreamer::WebStreamer(int webPort,
                   webPort == -1? static_cast<std::uint16_t>(
                       configuration_.getInt("webServer.port", 80)) : webPort),
       current_input_processor_(nullptr),
-      clients_(&encoding_pipeline_),
+      worker_pool_(std::make_shared<WorkerPool>(configuration_.getUInt(
+          "encodingPipeline.workerThreads",
+          static_cast<unsigned int>(DEFAULT_WORKER_THREAD_COUNT)))),
+      encoding_pipeline_(CreateEncodingPipeline()),
+      clients_(encoding_pipeline_.get(),
+               std::chrono::milliseconds(configuration_.getInt(
+                   "clients.idleBackoff",
+                   static_cast<int>(DEFAULT_CLIENT_UPDATE_BACKOFF.count())))),
       websocket_stream_(&configuration_, &stream_config_, &clients_, webSocketPort),
 #ifdef WEBSTREAMER_ENABLE_WEBRTC
       webrtc_stream_(&configuration_, &stream_config_, &clients_, webRtcPort),
@@ -62,6 +69,21 @@ WebStreamer::WebStreamer(int webPort,
 #ifndef WEBSTREAMER_ENABLE_WEBRTC
   std::cout << "No webrtc support. Designed port was " << webRtcPort << std::endl;
 #endif
+  // The thresholds are given in KiB
+  FrameDropPolicy frame_drop_policy;
+  frame_drop_policy.non_reference_threshold_in_bytes =
+      1024 * configuration_.getUInt(
+                 "clients.nonReferenceDropThreshold",
+                 static_cast<unsigned int>(
+                     frame_drop_policy.non_reference_threshold_in_bytes /
+                     1024));
+  frame_drop_policy.keyframe_threshold_in_bytes =
+      1024 * configuration_.getUInt(
+                 "clients.keyframeDropThreshold",
+                 static_cast<unsigned int>(
+                     frame_drop_policy.keyframe_threshold_in_bytes / 1024));
+  clients_.SetFrameDropPolicy(frame_drop_policy);
+
   stream_config_.propertyChanged +=
       StdFunctionDelegate<const Poco::Util::AbstractConfiguration::KeyValue>(
           [this](const void*,
@@ -74,11 +96,10 @@ WebStreamer::WebStreamer(int webPort,
         clients_.OnStreamConfigChanged();
       });
 
-  encoding_pipeline_.RegisterEncoderFactoryForCodec(Codec::RAW,
-                                                    &raw_encoder_factory_);
-
-  encoding_pipeline_.RegisterEncoderFactoryForCodec(Codec::H264,
-                                                    &h264_encoder_factory_);
+  if (configuration_.has("ingest.sharedMemory")) {
+    StartSharedMemoryIngest(configuration_.getString("ingest.sharedMemory"),
+                            configuration_.getString("ingest.source", ""));
+  }
 }
 
 InputProcessor* WebStreamer::RegisterInputProcessor(
@@ -98,10 +119,165 @@ InputProcessor* WebStreamer::DeregisterInputProcessor() {
 }
 
 void WebStreamer::PushFrame(std::size_t width, std::size_t height,
-                            const void* rgb_data, std::size_t size_in_bytes,
-                            bool flip_vertically) {
-  encoding_pipeline_.PushFrame(width, height, rgb_data, size_in_bytes,
-                               flip_vertically);
+                            const void* pixel_data, std::size_t size_in_bytes,
+                            bool flip_vertically, PixelFormat pixel_format) {
+  encoding_pipeline_->PushFrame(width, height, pixel_data, size_in_bytes,
+                                flip_vertically, pixel_format);
+}
+
+void WebStreamer::PushFrame(std::size_t width, std::size_t height,
+                            const void* pixel_data, std::size_t size_in_bytes,
+                            const std::vector<Rect>& damaged_regions,
+                            bool flip_vertically, PixelFormat pixel_format) {
+  encoding_pipeline_->PushFrame(width, height, pixel_data, size_in_bytes,
+                                damaged_regions, flip_vertically, pixel_format);
+}
+
+FrameBuffer& WebStreamer::AcquireWriteFrame(std::size_t width,
+                                            std::size_t height,
+                                            PixelFormat pixel_format) {
+  return encoding_pipeline_->AcquireWriteFrame(width, height, pixel_format);
+}
+
+void WebStreamer::CommitFrame() { encoding_pipeline_->CommitFrame(); }
+
+void WebStreamer::BeginTiledFrame(std::size_t width, std::size_t height,
+                                  std::size_t tile_count, bool flip_vertically,
+                                  PixelFormat pixel_format) {
+  encoding_pipeline_->BeginTiledFrame(width, height, tile_count,
+                                      flip_vertically, pixel_format);
+}
+
+void WebStreamer::WriteTile(const Rect& tile, const void* pixel_data,
+                            std::size_t source_stride) {
+  encoding_pipeline_->WriteTile(tile, pixel_data, source_stride);
+}
+
+void WebStreamer::PushFrame(const std::string& source_id, std::size_t width,
+                            std::size_t height, const void* pixel_data,
+                            std::size_t size_in_bytes, bool flip_vertically,
+                            PixelFormat pixel_format) {
+  GetSource(source_id)->PushFrame(width, height, pixel_data, size_in_bytes,
+                                  flip_vertically, pixel_format);
+}
+
+void WebStreamer::PushFrame(const std::string& source_id, std::size_t width,
+                            std::size_t height, const void* pixel_data,
+                            std::size_t size_in_bytes,
+                            const std::vector<Rect>& damaged_regions,
+                            bool flip_vertically, PixelFormat pixel_format) {
+  GetSource(source_id)->PushFrame(width, height, pixel_data, size_in_bytes,
+                                  damaged_regions, flip_vertically,
+                                  pixel_format);
+}
+
+FrameBuffer& WebStreamer::AcquireWriteFrame(const std::string& source_id,
+                                            std::size_t width,
+                                            std::size_t height,
+                                            PixelFormat pixel_format) {
+  return GetSource(source_id)->AcquireWriteFrame(width, height, pixel_format);
+}
+
+void WebStreamer::CommitFrame(const std::string& source_id) {
+  GetSource(source_id)->CommitFrame();
+}
+
+void WebStreamer::BeginTiledFrame(const std::string& source_id,
+                                  std::size_t width, std::size_t height,
+                                  std::size_t tile_count, bool flip_vertically,
+                                  PixelFormat pixel_format) {
+  GetSource(source_id)->BeginTiledFrame(width, height, tile_count,
+                                        flip_vertically, pixel_format);
+}
+
+void WebStreamer::WriteTile(const std::string& source_id, const Rect& tile,
+                            const void* pixel_data, std::size_t source_stride) {
+  GetSource(source_id)->WriteTile(tile, pixel_data, source_stride);
+}
+
+void WebStreamer::StartSharedMemoryIngest(const std::string& name,
+                                          const std::string& source_id) {
+  EncodingPipeline* encoding_pipeline = GetSource(source_id);
+  std::lock_guard<std::mutex> lock(shared_memory_ingests_mutex_);
+  shared_memory_ingests_.push_back(
+      std::make_unique<SharedMemoryIngest>(name, encoding_pipeline));
+  LOGI("Ingesting frames from shared memory ", name);
+}
+
+std::uint64_t WebStreamer::dropped_frame_count() {
+  std::lock_guard<std::mutex> lock(sources_mutex_);
+  std::uint64_t dropped_frame_count = encoding_pipeline_->dropped_frame_count();
+  for (const auto& source : sources_) {
+    dropped_frame_count += source.second->dropped_frame_count();
+  }
+  return dropped_frame_count;
+}
+
+std::uint64_t WebStreamer::decimated_frame_count() {
+  std::lock_guard<std::mutex> lock(sources_mutex_);
+  std::uint64_t decimated_frame_count =
+      encoding_pipeline_->decimated_frame_count();
+  for (const auto& source : sources_) {
+    decimated_frame_count += source.second->decimated_frame_count();
+  }
+  return decimated_frame_count;
+}
+
+std::uint64_t WebStreamer::deduplicated_frame_count() {
+  std::lock_guard<std::mutex> lock(sources_mutex_);
+  std::uint64_t deduplicated_frame_count =
+      encoding_pipeline_->deduplicated_frame_count();
+  for (const auto& source : sources_) {
+    deduplicated_frame_count += source.second->deduplicated_frame_count();
+  }
+  return deduplicated_frame_count;
+}
+
+std::uint64_t WebStreamer::client_dropped_frame_count() {
+  return clients_.dropped_frame_count();
+}
+
+std::uint64_t WebStreamer::requested_keyframe_count() {
+  return clients_.requested_keyframe_count();
+}
+
+std::unique_ptr<EncodingPipeline> WebStreamer::CreateEncodingPipeline() {
+  auto encoding_pipeline = std::make_unique<EncodingPipeline>(
+      configuration_.getUInt(
+          "encodingPipeline.frameRingSize",
+          static_cast<unsigned int>(DEFAULT_FRAME_RING_SIZE)),
+      std::chrono::milliseconds(configuration_.getInt(
+          "encodingPipeline.idleBackoff",
+          static_cast<int>(DEFAULT_ENCODER_IDLE_BACKOFF.count()))),
+      worker_pool_,
+      configuration_.getUInt(
+          "encodingPipeline.strideAlignment",
+          static_cast<unsigned int>(FrameBuffer::DEFAULT_STRIDE_ALIGNMENT)),
+      configuration_.getBool("encodingPipeline.hugePages", false),
+      configuration_.getBool("encodingPipeline.deduplicateFrames", false));
+
+  // The factories are only stored, so it does not matter that they are not
+  // constructed yet when the default pipeline is created.
+  encoding_pipeline->RegisterEncoderFactoryForCodec(Codec::RAW,
+                                                    &raw_encoder_factory_);
+  encoding_pipeline->RegisterEncoderFactoryForCodec(Codec::H264,
+                                                    &h264_encoder_factory_);
+  return encoding_pipeline;
+}
+
+EncodingPipeline* WebStreamer::GetSource(const std::string& source_id) {
+  if (source_id.empty()) {
+    return encoding_pipeline_.get();
+  }
+
+  std::lock_guard<std::mutex> lock(sources_mutex_);
+  auto& encoding_pipeline = sources_[source_id];
+  if (encoding_pipeline == nullptr) {
+    LOGI("Created source: ", source_id);
+    encoding_pipeline = CreateEncodingPipeline();
+    clients_.AddSource(source_id, encoding_pipeline.get());
+  }
+  return encoding_pipeline.get();
 }
 
 }  // namespace webstreamer
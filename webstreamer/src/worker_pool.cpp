@@ -0,0 +1,107 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "webstreamer/worker_pool.hpp"
+#include <algorithm>
+
+namespace webstreamer {
+
+WorkerPool::WorkerPool(std::size_t thread_count) {
+  threads_.reserve(thread_count);
+  for (std::size_t i = 0; i < thread_count; ++i) {
+    threads_.emplace_back(&WorkerPool::WorkerThread, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  job_available_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkerPool::ParallelFor(std::size_t count,
+                             const std::function<void(std::size_t)>& function) {
+  if (count == 0) {
+    return;
+  }
+  if (count == 1 || threads_.empty()) {
+    for (std::size_t i = 0; i < count; ++i) {
+      function(i);
+    }
+    return;
+  }
+
+  Job job;
+  job.function = &function;
+  job.count = count;
+  job.next_index = 0;
+  job.worker_count = 0;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(&job);
+  }
+  job_available_.notify_all();
+
+  RunJob(&job);
+
+  // All iterations have been started at this point. Make sure no worker picks
+  // up the job anymore and wait for the ones that are still running.
+  std::unique_lock<std::mutex> lock(mutex_);
+  jobs_.erase(std::remove(jobs_.begin(), jobs_.end(), &job), jobs_.end());
+  job_finished_.wait(lock, [&job]() { return job.worker_count == 0; });
+}
+
+void WorkerPool::WorkerThread() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    job_available_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+    if (stop_) {
+      return;
+    }
+
+    Job* job = jobs_.front();
+    ++job->worker_count;
+    lock.unlock();
+    RunJob(job);
+    lock.lock();
+
+    jobs_.erase(std::remove(jobs_.begin(), jobs_.end(), job), jobs_.end());
+    if (--job->worker_count == 0) {
+      job_finished_.notify_all();
+    }
+  }
+}
+
+void WorkerPool::RunJob(Job* job) {
+  for (std::size_t i = job->next_index.fetch_add(1); i < job->count;
+       i = job->next_index.fetch_add(1)) {
+    (*job->function)(i);
+  }
+}
+
+}  // namespace webstreamer
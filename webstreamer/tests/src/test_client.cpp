@@ -0,0 +1,202 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "catch/catch.hpp"
+#include "webstreamer/client.hpp"
+
+namespace {
+
+// Frames stay in the send queue until SendQueuedFrames() is called, so the
+// queued bytes count towards the frame drop policy.
+class StubClient : public webstreamer::Client {
+ public:
+  explicit StubClient(const webstreamer::FrameDropPolicy& frame_drop_policy) {
+    set_frame_drop_policy(frame_drop_policy);
+  }
+  ~StubClient() override { StopSending(); }
+
+  using webstreamer::Client::set_buffered_amount;
+
+  // Returns the indices of the frames (or frame parts) that were queued
+  std::vector<std::uint64_t> SendQueuedFrames(std::size_t frame_count) {
+    StartSending();
+    std::unique_lock<std::mutex> lock(sent_frames_mutex_);
+    sent_frames_condition_.wait_for(lock, std::chrono::seconds(5), [&]() {
+      return sent_frame_indices_.size() >= frame_count;
+    });
+    return sent_frame_indices_;
+  }
+
+  void OnFrameEncoded(const webstreamer::EncodedFrame& encoded_frame) override {
+    {
+      std::lock_guard<std::mutex> lock(sent_frames_mutex_);
+      sent_frame_indices_.push_back(encoded_frame.frame_index);
+    }
+    sent_frames_condition_.notify_one();
+  }
+  void OnCodecSwitched(webstreamer::Codec codec,
+                       const webstreamer::CodecOptions& options) override {
+    (void)codec;
+    (void)options;
+  }
+  void SendEvent(const webstreamer::Event& event) override { (void)event; }
+
+ private:
+  std::mutex sent_frames_mutex_;
+  std::condition_variable sent_frames_condition_;
+  std::vector<std::uint64_t> sent_frame_indices_;
+};
+
+webstreamer::FrameDropPolicy CreateFrameDropPolicy() {
+  webstreamer::FrameDropPolicy frame_drop_policy;
+  frame_drop_policy.non_reference_threshold_in_bytes = 100;
+  frame_drop_policy.keyframe_threshold_in_bytes = 1000;
+  return frame_drop_policy;
+}
+
+webstreamer::EncodedFrame CreateFrame(std::uint64_t frame_index,
+                                      std::size_t size_in_bytes,
+                                      bool is_keyframe = false,
+                                      bool is_reference = true) {
+  webstreamer::EncodedFrame encoded_frame;
+  encoded_frame.serialized_frame =
+      std::make_shared<const std::vector<std::uint8_t>>(size_in_bytes);
+  encoded_frame.frame_index = frame_index;
+  encoded_frame.is_keyframe = is_keyframe;
+  encoded_frame.is_reference = is_reference;
+  return encoded_frame;
+}
+
+}  // namespace
+
+TEST_CASE("Client drops non-reference frames when it falls behind",
+          "[client]") {
+  StubClient client(CreateFrameDropPolicy());
+  CHECK(client.PushFrame(CreateFrame(1, 60, true)));
+  CHECK(client.PushFrame(CreateFrame(2, 10, false, false)));
+  CHECK(client.PushFrame(CreateFrame(3, 60)));
+  CHECK(client.dropped_frame_count() == 0);
+
+  // 130 bytes are queued now
+  CHECK(client.PushFrame(CreateFrame(4, 10, false, false)));
+  CHECK(client.dropped_frame_count() == 1);
+  CHECK(client.PushFrame(CreateFrame(5, 10)));
+
+  // Data buffered by the connection counts as well
+  client.set_buffered_amount(200);
+  CHECK(client.PushFrame(CreateFrame(6, 10, false, false)));
+  CHECK(client.dropped_frame_count() == 2);
+  CHECK(client.requested_keyframe_count() == 0);
+
+  const std::vector<std::uint64_t> sent_frame_indices{1, 2, 3, 5};
+  CHECK(client.SendQueuedFrames(sent_frame_indices.size()) ==
+        sent_frame_indices);
+}
+
+TEST_CASE("Client drops all parts of a dropped frame", "[client]") {
+  StubClient client(CreateFrameDropPolicy());
+  client.set_buffered_amount(150);
+
+  webstreamer::EncodedFrame frame_part = CreateFrame(1, 10, false, false);
+  for (std::size_t i = 0; i < 3; ++i) {
+    frame_part.part_index = i;
+    frame_part.is_last_part = i == 2;
+    CHECK(client.PushFrame(frame_part));
+  }
+  CHECK(client.dropped_frame_count() == 1);
+
+  // Only the first part decides whether a frame is dropped
+  frame_part = CreateFrame(2, 10);
+  CHECK(client.PushFrame(frame_part));
+  frame_part.is_reference = false;
+  frame_part.part_index = 1;
+  CHECK(client.PushFrame(frame_part));
+  CHECK(client.dropped_frame_count() == 1);
+
+  const std::vector<std::uint64_t> sent_frame_indices{2, 2};
+  CHECK(client.SendQueuedFrames(sent_frame_indices.size()) ==
+        sent_frame_indices);
+}
+
+TEST_CASE("Client discards its queue and waits for a keyframe", "[client]") {
+  StubClient client(CreateFrameDropPolicy());
+  for (std::uint64_t i = 1; i <= 4; ++i) {
+    CHECK(client.PushFrame(CreateFrame(i, 200, i == 1)));
+  }
+  CHECK(client.dropped_frame_count() == 0);
+
+  // Exceeding the keyframe threshold discards the four queued frames
+  CHECK(client.PushFrame(CreateFrame(5, 300)));
+  CHECK(client.dropped_frame_count() == 5);
+
+  // The keyframe is requested once the connection caught up
+  client.set_buffered_amount(500);
+  CHECK(client.PushFrame(CreateFrame(6, 10)));
+  CHECK(client.requested_keyframe_count() == 0);
+  client.set_buffered_amount(0);
+  CHECK_FALSE(client.PushFrame(CreateFrame(7, 10)));
+  CHECK(client.requested_keyframe_count() == 1);
+
+  // The keyframe is requested only once
+  CHECK(client.PushFrame(CreateFrame(8, 10)));
+  CHECK(client.requested_keyframe_count() == 1);
+  CHECK(client.dropped_frame_count() == 8);
+
+  CHECK(client.PushFrame(CreateFrame(9, 10, true)));
+  CHECK(client.PushFrame(CreateFrame(10, 10)));
+  CHECK(client.dropped_frame_count() == 8);
+
+  const std::vector<std::uint64_t> sent_frame_indices{9, 10};
+  CHECK(client.SendQueuedFrames(sent_frame_indices.size()) ==
+        sent_frame_indices);
+}
+
+TEST_CASE("Client requests another keyframe if it arrives too early",
+          "[client]") {
+  StubClient client(CreateFrameDropPolicy());
+  CHECK(client.PushFrame(CreateFrame(1, 600, true)));
+  CHECK(client.PushFrame(CreateFrame(2, 500)));
+  CHECK(client.dropped_frame_count() == 2);
+  CHECK_FALSE(client.PushFrame(CreateFrame(3, 10)));
+  CHECK(client.requested_keyframe_count() == 1);
+
+  // The connection is still busy when the requested keyframe arrives
+  client.set_buffered_amount(500);
+  CHECK(client.PushFrame(CreateFrame(4, 10, true)));
+  CHECK(client.dropped_frame_count() == 4);
+
+  client.set_buffered_amount(0);
+  CHECK_FALSE(client.PushFrame(CreateFrame(5, 10)));
+  CHECK(client.requested_keyframe_count() == 2);
+  CHECK(client.PushFrame(CreateFrame(6, 10, true)));
+  CHECK(client.dropped_frame_count() == 5);
+
+  const std::vector<std::uint64_t> sent_frame_indices{6};
+  CHECK(client.SendQueuedFrames(sent_frame_indices.size()) ==
+        sent_frame_indices);
+}
@@ -0,0 +1,183 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "catch/catch.hpp"
+#include "webstreamer/color_conversion.hpp"
+#include "webstreamer/worker_pool.hpp"
+#include "webstreamer/suppress_warnings.hpp"
+SUPPRESS_WARNINGS_BEGIN
+extern "C" {
+#include "libswscale/swscale.h"
+}
+SUPPRESS_WARNINGS_END
+
+namespace {
+
+struct I420Frame {
+  I420Frame(std::size_t width, std::size_t height)
+      : strides{width, (width + 1) / 2, (width + 1) / 2},
+        heights{height, (height + 1) / 2, (height + 1) / 2} {
+    for (std::size_t i = 0; i < 3; ++i) {
+      planes[i].resize(strides[i] * heights[i]);
+      plane_pointers[i] = planes[i].data();
+    }
+  }
+
+  std::size_t strides[3];
+  std::size_t heights[3];
+  std::vector<std::uint8_t> planes[3];
+  std::uint8_t* plane_pointers[3];
+};
+
+// Smooth content, as the chroma filters of swscale and ConvertToI420() only
+// differ at edges.
+std::vector<std::uint8_t> CreateGradient(std::size_t width,
+                                         std::size_t height) {
+  std::vector<std::uint8_t> rgb(width * height * 3);
+  for (std::size_t y = 0; y < height; ++y) {
+    for (std::size_t x = 0; x < width; ++x) {
+      std::uint8_t* pixel = &rgb[(y * width + x) * 3];
+      pixel[0] = static_cast<std::uint8_t>(x * 255 / width);
+      pixel[1] = static_cast<std::uint8_t>(y * 255 / height);
+      pixel[2] = static_cast<std::uint8_t>(255 - (x + y) * 127 / width);
+    }
+  }
+  return rgb;
+}
+
+int GetMaximumDifference(const std::vector<std::uint8_t>& a,
+                         const std::vector<std::uint8_t>& b) {
+  int maximum_difference = 0;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    maximum_difference = std::max(maximum_difference, std::abs(a[i] - b[i]));
+  }
+  return maximum_difference;
+}
+
+}  // namespace
+
+TEST_CASE("ConvertToI420 matches swscale", "[color_conversion]") {
+  using webstreamer::ConvertToI420;
+  using webstreamer::PixelFormat;
+
+  const int width = 320;
+  const int height = 240;
+  const std::vector<std::uint8_t> rgb = CreateGradient(width, height);
+
+  I420Frame converted(width, height);
+  ConvertToI420(rgb.data(), width * 3, PixelFormat::RGB, width, height,
+                converted.plane_pointers, converted.strides);
+
+  I420Frame reference(width, height);
+  SwsContext* sws_context =
+      sws_getContext(width, height, AV_PIX_FMT_RGB24, width, height,
+                     AV_PIX_FMT_YUV420P, SWS_BICUBIC, nullptr, nullptr,
+                     nullptr);
+  REQUIRE(sws_context != nullptr);
+  const std::uint8_t* source_slice[] = {rgb.data()};
+  const int source_stride[] = {width * 3};
+  const int reference_strides[] = {static_cast<int>(reference.strides[0]),
+                                   static_cast<int>(reference.strides[1]),
+                                   static_cast<int>(reference.strides[2])};
+  sws_scale(sws_context, source_slice, source_stride, 0, height,
+            reference.plane_pointers, reference_strides);
+  sws_freeContext(sws_context);
+
+  // swscale uses 15 bit coefficients and dithering
+  CHECK(GetMaximumDifference(converted.planes[0], reference.planes[0]) <= 1);
+  CHECK(GetMaximumDifference(converted.planes[1], reference.planes[1]) <= 2);
+  CHECK(GetMaximumDifference(converted.planes[2], reference.planes[2]) <= 2);
+}
+
+TEST_CASE("ConvertToI420 is bit-exact for all instruction sets",
+          "[color_conversion]") {
+  using webstreamer::ConvertToI420;
+  using webstreamer::GetBytesPerPixel;
+  using webstreamer::GetSupportedInstructionSet;
+  using webstreamer::InstructionSet;
+  using webstreamer::PixelFormat;
+
+  const PixelFormat pixel_formats[] = {PixelFormat::RGB, PixelFormat::BGR,
+                                       PixelFormat::RGBA, PixelFormat::BGRA};
+  const InstructionSet instruction_sets[] = {InstructionSet::SSE4_1,
+                                             InstructionSet::AVX2};
+  std::srand(42);
+
+  for (PixelFormat pixel_format : pixel_formats) {
+    // Odd sizes and sizes that are not a multiple of the vector width
+    for (std::size_t width = 1; width <= 37; width += 3) {
+      for (std::size_t height = 1; height <= 5; ++height) {
+        const std::size_t stride = width * GetBytesPerPixel(pixel_format);
+        std::vector<std::uint8_t> pixels(stride * height);
+        for (std::uint8_t& value : pixels) {
+          value = static_cast<std::uint8_t>(std::rand());
+        }
+
+        I420Frame expected(width, height);
+        ConvertToI420(pixels.data(), stride, pixel_format, width, height,
+                      expected.plane_pointers, expected.strides, nullptr,
+                      InstructionSet::SCALAR);
+
+        for (InstructionSet instruction_set : instruction_sets) {
+          if (instruction_set > GetSupportedInstructionSet()) {
+            continue;
+          }
+          I420Frame converted(width, height);
+          ConvertToI420(pixels.data(), stride, pixel_format, width, height,
+                        converted.plane_pointers, converted.strides, nullptr,
+                        instruction_set);
+          for (std::size_t plane = 0; plane < 3; ++plane) {
+            CHECK(converted.planes[plane] == expected.planes[plane]);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("ConvertToI420 converts slices on the worker pool",
+          "[color_conversion]") {
+  using webstreamer::ConvertToI420;
+  using webstreamer::PixelFormat;
+  using webstreamer::WorkerPool;
+
+  // An odd height, so the last slice contains a single luma row at the end
+  const std::size_t width = 100;
+  const std::size_t height = 515;
+  const std::vector<std::uint8_t> rgb = CreateGradient(width, height);
+
+  I420Frame expected(width, height);
+  ConvertToI420(rgb.data(), width * 3, PixelFormat::RGB, width, height,
+                expected.plane_pointers, expected.strides);
+
+  WorkerPool worker_pool(3);
+  I420Frame converted(width, height);
+  ConvertToI420(rgb.data(), width * 3, PixelFormat::RGB, width, height,
+                converted.plane_pointers, converted.strides, &worker_pool);
+  for (std::size_t plane = 0; plane < 3; ++plane) {
+    CHECK(converted.planes[plane] == expected.planes[plane]);
+  }
+}
@@ -0,0 +1,199 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "catch/catch.hpp"
+#include "webstreamer/frame_ring.hpp"
+#include "webstreamer/frame_scaling.hpp"
+
+namespace {
+
+const std::size_t WIDTH = 8;
+const std::size_t HEIGHT = 8;
+
+// Fills the frame with the low byte of the index of the frame that is written
+std::uint64_t WriteFrame(webstreamer::FrameRing* frame_ring) {
+  webstreamer::FrameBuffer& frame_buffer = frame_ring->BeginWrite();
+  frame_buffer.ResizeIfNecessary(WIDTH, HEIGHT);
+  std::memset(frame_buffer.pixel_data(),
+              static_cast<int>((frame_ring->latest_frame_index() + 1) & 0xff),
+              frame_buffer.size_in_bytes());
+  return frame_ring->Publish();
+}
+
+bool HasFrameContents(const webstreamer::FrameRing::Reference& reference) {
+  const webstreamer::FrameBuffer& frame_buffer = reference.frame_buffer();
+  const auto pixels =
+      static_cast<const std::uint8_t*>(frame_buffer.pixel_data());
+  for (std::size_t i = 0; i < frame_buffer.size_in_bytes(); ++i) {
+    if (pixels[i] != (reference.frame_index() & 0xff)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+TEST_CASE("FrameRing publishes frames in order", "[frame_ring]") {
+  webstreamer::FrameRing frame_ring(3);
+  CHECK(frame_ring.latest_frame_index() == 0);
+  CHECK_FALSE(frame_ring.AcquireLatest());
+
+  CHECK(WriteFrame(&frame_ring) == 1);
+  CHECK(WriteFrame(&frame_ring) == 2);
+  CHECK(frame_ring.latest_frame_index() == 2);
+
+  const auto reference = frame_ring.AcquireLatest();
+  REQUIRE(reference);
+  CHECK(reference.frame_index() == 2);
+  CHECK(HasFrameContents(reference));
+}
+
+TEST_CASE("FrameRing keeps the latest frame when a write is canceled",
+          "[frame_ring]") {
+  webstreamer::FrameRing frame_ring(3);
+  WriteFrame(&frame_ring);
+  WriteFrame(&frame_ring);
+
+  frame_ring.BeginWrite();
+  frame_ring.CancelWrite();
+  CHECK(frame_ring.latest_frame_index() == 2);
+  const auto reference = frame_ring.AcquireLatest();
+  REQUIRE(reference);
+  CHECK(reference.frame_index() == 2);
+
+  // The canceled write does not use up a frame index
+  CHECK(WriteFrame(&frame_ring) == 3);
+}
+
+TEST_CASE("FrameRing never overwrites pinned frames", "[frame_ring]") {
+  webstreamer::FrameRing frame_ring(3);
+  WriteFrame(&frame_ring);
+  auto pinned_reference = frame_ring.AcquireLatest();
+  REQUIRE(pinned_reference);
+  const webstreamer::FrameBuffer* const pinned_frame_buffer =
+      &pinned_reference.frame_buffer();
+
+  for (int i = 0; i < 10; ++i) {
+    webstreamer::FrameBuffer& frame_buffer = frame_ring.BeginWrite();
+    CHECK(&frame_buffer != pinned_frame_buffer);
+    frame_ring.Publish();
+  }
+  CHECK(pinned_reference.frame_index() == 1);
+  CHECK(HasFrameContents(pinned_reference));
+
+  // Once the reference is released, the slot is reused
+  pinned_reference = webstreamer::FrameRing::Reference();
+  bool has_reused_slot = false;
+  for (int i = 0; i < 2; ++i) {
+    has_reused_slot |= &frame_ring.BeginWrite() == pinned_frame_buffer;
+    frame_ring.Publish();
+  }
+  CHECK(has_reused_slot);
+}
+
+TEST_CASE("FrameRing consumers never see partially written frames",
+          "[frame_ring]") {
+  const std::uint64_t FRAME_COUNT = 2000;
+  webstreamer::FrameRing frame_ring(4);
+  std::atomic<bool> has_torn_frame(false);
+
+  std::vector<std::thread> consumers;
+  for (int i = 0; i < 2; ++i) {
+    consumers.emplace_back([&]() {
+      while (frame_ring.latest_frame_index() < FRAME_COUNT) {
+        const auto reference = frame_ring.AcquireLatest();
+        if (reference && !HasFrameContents(reference)) {
+          has_torn_frame = true;
+        }
+      }
+    });
+  }
+  for (std::uint64_t i = 0; i < FRAME_COUNT; ++i) {
+    WriteFrame(&frame_ring);
+  }
+  for (auto& consumer : consumers) {
+    consumer.join();
+  }
+
+  CHECK_FALSE(has_torn_frame);
+}
+
+TEST_CASE("FrameRing converts each frame to I420 once", "[frame_ring]") {
+  webstreamer::FrameRing frame_ring(3);
+  WriteFrame(&frame_ring);
+
+  const auto first_reference = frame_ring.AcquireLatest();
+  const auto second_reference = frame_ring.AcquireLatest();
+  const webstreamer::FrameBuffer& i420_frame_buffer =
+      first_reference.GetI420FrameBuffer(nullptr);
+  CHECK(i420_frame_buffer.pixel_format() == webstreamer::PixelFormat::I420);
+  CHECK(i420_frame_buffer.info().frame_index == 1);
+  CHECK(&second_reference.GetI420FrameBuffer(nullptr) == &i420_frame_buffer);
+}
+
+TEST_CASE("FrameRing derives pyramid levels from the next larger level",
+          "[frame_ring]") {
+  webstreamer::FrameRing frame_ring(3);
+  frame_ring.AddPyramidLevel(16, 12);
+  frame_ring.AddPyramidLevel(32, 24);
+
+  webstreamer::FrameBuffer& frame_buffer = frame_ring.BeginWrite();
+  frame_buffer.ResizeIfNecessary(64, 48);
+  auto pixels = static_cast<std::uint8_t*>(frame_buffer.pixel_data());
+  std::uint32_t state = 1;
+  for (std::size_t i = 0; i < frame_buffer.size_in_bytes(); ++i) {
+    state = state * 1103515245 + 12345;
+    pixels[i] = static_cast<std::uint8_t>(state >> 16);
+  }
+  frame_ring.Publish();
+
+  const auto first_reference = frame_ring.AcquireLatest();
+  const auto second_reference = frame_ring.AcquireLatest();
+  const webstreamer::FrameBuffer& level =
+      first_reference.GetScaledI420FrameBuffer(16, 12, nullptr);
+  CHECK(level.width() == 16);
+  CHECK(level.height() == 12);
+  CHECK(level.pixel_format() == webstreamer::PixelFormat::I420);
+  CHECK(level.info().frame_index == 1);
+  CHECK(&second_reference.GetScaledI420FrameBuffer(16, 12, nullptr) == &level);
+
+  webstreamer::FrameBuffer expected_level(16, 12,
+                                          webstreamer::PixelFormat::I420);
+  webstreamer::ScaleI420(
+      second_reference.GetScaledI420FrameBuffer(32, 24, nullptr),
+      &expected_level);
+  bool is_derived = true;
+  for (std::size_t plane = 0; plane < 3; ++plane) {
+    for (std::size_t y = 0; y < level.GetPlaneHeight(plane); ++y) {
+      is_derived &= std::memcmp(level.GetPlaneRowData(plane, y),
+                                expected_level.GetPlaneRowData(plane, y),
+                                level.GetPlaneRowSize(plane)) == 0;
+    }
+  }
+  CHECK(is_derived);
+}
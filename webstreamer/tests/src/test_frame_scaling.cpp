@@ -0,0 +1,202 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "catch/catch.hpp"
+#include "webstreamer/frame_scaling.hpp"
+#include "webstreamer/worker_pool.hpp"
+
+namespace {
+
+using webstreamer::FrameBuffer;
+using webstreamer::PixelFormat;
+
+void FillPlane(FrameBuffer* frame_buffer, std::size_t plane,
+               std::uint8_t value) {
+  for (std::size_t y = 0; y < frame_buffer->GetPlaneHeight(plane); ++y) {
+    std::memset(frame_buffer->GetPlaneRowData(plane, y), value,
+                frame_buffer->GetPlaneRowSize(plane));
+  }
+}
+
+// Pseudo random values, so every source pixel contributes a distinct value
+void FillPlaneWithNoise(FrameBuffer* frame_buffer, std::size_t plane) {
+  std::uint32_t state = 1;
+  for (std::size_t y = 0; y < frame_buffer->GetPlaneHeight(plane); ++y) {
+    auto row =
+        static_cast<std::uint8_t*>(frame_buffer->GetPlaneRowData(plane, y));
+    for (std::size_t x = 0; x < frame_buffer->GetPlaneRowSize(plane); ++x) {
+      state = state * 1103515245 + 12345;
+      row[x] = static_cast<std::uint8_t>(state >> 16);
+    }
+  }
+}
+
+std::uint8_t GetPixel(const FrameBuffer& frame_buffer, std::size_t plane,
+                      std::size_t x, std::size_t y) {
+  return static_cast<const std::uint8_t*>(
+      frame_buffer.GetPlaneRowData(plane, y))[x];
+}
+
+// The fraction of the source pixel that is covered by the destination pixel,
+// measured in source pixels.
+double GetCoverage(std::size_t source_index, std::size_t destination_index,
+                   double ratio) {
+  const double begin = static_cast<double>(destination_index) * ratio;
+  const double end = static_cast<double>(destination_index + 1) * ratio;
+  return std::max(0.0, std::min(end, static_cast<double>(source_index + 1)) -
+                           std::max(begin, static_cast<double>(source_index)));
+}
+
+// Returns the largest difference to the exact area average
+int GetMaximumAreaAverageError(const FrameBuffer& source,
+                               const FrameBuffer& destination,
+                               std::size_t plane) {
+  const std::size_t source_width = source.GetPlaneRowSize(plane);
+  const std::size_t source_height = source.GetPlaneHeight(plane);
+  const std::size_t destination_width = destination.GetPlaneRowSize(plane);
+  const std::size_t destination_height = destination.GetPlaneHeight(plane);
+  const double horizontal_ratio = static_cast<double>(source_width) /
+                                  static_cast<double>(destination_width);
+  const double vertical_ratio = static_cast<double>(source_height) /
+                                static_cast<double>(destination_height);
+
+  int maximum_error = 0;
+  for (std::size_t y = 0; y < destination_height; ++y) {
+    for (std::size_t x = 0; x < destination_width; ++x) {
+      double sum = 0.0;
+      for (std::size_t source_y = 0; source_y < source_height; ++source_y) {
+        const double vertical_coverage =
+            GetCoverage(source_y, y, vertical_ratio);
+        if (vertical_coverage == 0.0) {
+          continue;
+        }
+        for (std::size_t source_x = 0; source_x < source_width; ++source_x) {
+          sum += vertical_coverage *
+                 GetCoverage(source_x, x, horizontal_ratio) *
+                 GetPixel(source, plane, source_x, source_y);
+        }
+      }
+      const int expected = static_cast<int>(
+          std::lround(sum / (horizontal_ratio * vertical_ratio)));
+      maximum_error = std::max(
+          maximum_error,
+          std::abs(expected - GetPixel(destination, plane, x, y)));
+    }
+  }
+  return maximum_error;
+}
+
+}  // namespace
+
+TEST_CASE("ScaleI420 keeps constant planes constant", "[frame_scaling]") {
+  const std::size_t sizes[][4] = {
+      {64, 48, 32, 24},   // integer ratio
+      {100, 75, 33, 17},  // fractional ratio, odd chroma sizes
+      {7, 5, 20, 13},     // upscaling
+      {9, 9, 9, 9}};      // same size
+
+  for (const auto& size : sizes) {
+    FrameBuffer source(size[0], size[1], PixelFormat::I420);
+    FrameBuffer destination(size[2], size[3], PixelFormat::I420);
+    const std::uint8_t values[] = {235, 16, 128};
+    for (std::size_t plane = 0; plane < 3; ++plane) {
+      FillPlane(&source, plane, values[plane]);
+      FillPlane(&destination, plane, 0);
+    }
+
+    webstreamer::ScaleI420(source, &destination);
+
+    for (std::size_t plane = 0; plane < 3; ++plane) {
+      bool is_constant = true;
+      for (std::size_t y = 0; y < destination.GetPlaneHeight(plane); ++y) {
+        for (std::size_t x = 0; x < destination.GetPlaneRowSize(plane); ++x) {
+          is_constant &= GetPixel(destination, plane, x, y) == values[plane];
+        }
+      }
+      INFO(size[0] << "x" << size[1] << " -> " << size[2] << "x" << size[3]
+                   << ", plane " << plane);
+      CHECK(is_constant);
+    }
+  }
+}
+
+TEST_CASE("ScaleI420 averages the covered source pixels", "[frame_scaling]") {
+  // The ratio of 2.5 moves the taps of the last pixel of each row and column
+  // back, and the chroma planes have odd sizes (25x15 -> 5x3).
+  FrameBuffer source(50, 30, PixelFormat::I420);
+  FrameBuffer destination(20, 12, PixelFormat::I420);
+  for (std::size_t plane = 0; plane < 3; ++plane) {
+    FillPlaneWithNoise(&source, plane);
+  }
+
+  webstreamer::ScaleI420(source, &destination);
+
+  // The filter weights have 7 fractional bits
+  for (std::size_t plane = 0; plane < 3; ++plane) {
+    INFO("plane " << plane);
+    CHECK(GetMaximumAreaAverageError(source, destination, plane) <= 2);
+  }
+}
+
+TEST_CASE("ScaleI420 upscales with nearest neighbour filtering",
+          "[frame_scaling]") {
+  FrameBuffer source(5, 3, PixelFormat::I420);
+  FrameBuffer destination(10, 6, PixelFormat::I420);
+  for (std::size_t plane = 0; plane < 3; ++plane) {
+    FillPlaneWithNoise(&source, plane);
+  }
+
+  webstreamer::ScaleI420(source, &destination);
+
+  bool is_nearest_neighbour = true;
+  for (std::size_t y = 0; y < destination.height(); ++y) {
+    for (std::size_t x = 0; x < destination.width(); ++x) {
+      is_nearest_neighbour &=
+          GetPixel(destination, 0, x, y) == GetPixel(source, 0, x / 2, y / 2);
+    }
+  }
+  CHECK(is_nearest_neighbour);
+}
+
+TEST_CASE("ScaleI420 produces the same result on the worker pool",
+          "[frame_scaling]") {
+  FrameBuffer source(640, 360, PixelFormat::I420);
+  for (std::size_t plane = 0; plane < 3; ++plane) {
+    FillPlaneWithNoise(&source, plane);
+  }
+
+  FrameBuffer destination(427, 240, PixelFormat::I420);
+  webstreamer::ScaleI420(source, &destination);
+  FrameBuffer parallel_destination(427, 240, PixelFormat::I420);
+  webstreamer::WorkerPool worker_pool(3);
+  webstreamer::ScaleI420(source, &parallel_destination, &worker_pool);
+
+  REQUIRE(destination.size_in_bytes() == parallel_destination.size_in_bytes());
+  CHECK(std::memcmp(destination.pixel_data(), parallel_destination.pixel_data(),
+                    destination.size_in_bytes()) == 0);
+}
@@ -0,0 +1,71 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <cstdint>
+#include <vector>
+#include "catch/catch.hpp"
+#include "webstreamer/h264_nal_units.hpp"
+
+namespace {
+
+// SPS, PPS and a slice of a keyframe followed by a non-reference slice, with
+// both start code lengths
+const std::vector<std::uint8_t> BYTE_STREAM = {
+    0, 0, 0, 1, 0x67, 0x42, 0x00, 0x1f,  // SPS
+    0, 0, 0, 1, 0x68, 0xce, 0x3c, 0x80,  // PPS
+    0, 0, 1,    0x65, 0x88, 0x84, 0x00,  // IDR slice
+    0, 0, 1,    0x01, 0x9a, 0x02};       // non-reference slice
+
+}  // namespace
+
+TEST_CASE("ParseH264NalUnits splits the byte stream at start codes",
+          "[h264_nal_units]") {
+  const auto nal_units =
+      webstreamer::ParseH264NalUnits(BYTE_STREAM.data(), BYTE_STREAM.size());
+  REQUIRE(nal_units.size() == 4);
+
+  CHECK(nal_units[0].type == webstreamer::H264_NAL_SPS);
+  CHECK(nal_units[0].ref_idc == 3);
+  CHECK(nal_units[0].data == BYTE_STREAM.data() + 4);
+  CHECK(nal_units[0].size_in_bytes == 4);
+  CHECK(nal_units[1].type == webstreamer::H264_NAL_PPS);
+  CHECK(nal_units[1].size_in_bytes == 4);
+  CHECK(nal_units[2].type == webstreamer::H264_NAL_SLICE_IDR);
+  CHECK(nal_units[2].ref_idc == 3);
+  // The trailing zero byte belongs to the start code of the next unit
+  CHECK(nal_units[2].size_in_bytes == 3);
+  CHECK(nal_units[3].type == webstreamer::H264_NAL_SLICE);
+  CHECK(nal_units[3].ref_idc == 0);
+  CHECK(nal_units[3].size_in_bytes == 3);
+}
+
+TEST_CASE("IsH264NonReferenceFrame only accepts unreferenced slices",
+          "[h264_nal_units]") {
+  // The last slice only
+  CHECK(webstreamer::IsH264NonReferenceFrame(BYTE_STREAM.data() + 23,
+                                             BYTE_STREAM.size() - 23));
+  // Contains a referenced slice
+  CHECK_FALSE(webstreamer::IsH264NonReferenceFrame(BYTE_STREAM.data(),
+                                                   BYTE_STREAM.size()));
+  // Parameter sets only
+  CHECK_FALSE(webstreamer::IsH264NonReferenceFrame(BYTE_STREAM.data(), 16));
+}
@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+// Web Streamer
+//
+// Copyright (c) 2017 RWTH Aachen University, Germany,
+// Virtual Reality & Immersive Visualization Group.
+//------------------------------------------------------------------------------
+//                                 License
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "catch/catch.hpp"
+#include "webstreamer/shared_frame_ring.hpp"
+#include "webstreamer/shared_memory_producer.hpp"
+
+namespace {
+
+const std::size_t WIDTH = 16;
+const std::size_t HEIGHT = 16;
+
+class SharedMemoryMapping {
+ public:
+  explicit SharedMemoryMapping(const std::string& name) {
+    const int file_descriptor =
+        shm_open(webstreamer::GetSharedFrameRingPath(name).c_str(), O_RDWR, 0);
+    REQUIRE(file_descriptor >= 0);
+    struct stat file_status;
+    REQUIRE(fstat(file_descriptor, &file_status) == 0);
+    size_ = static_cast<std::size_t>(file_status.st_size);
+    mapping_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    file_descriptor, 0);
+    close(file_descriptor);
+    REQUIRE(mapping_ != MAP_FAILED);
+  }
+  ~SharedMemoryMapping() { munmap(mapping_, size_); }
+
+  webstreamer::SharedFrameRingHeader* header() const {
+    return static_cast<webstreamer::SharedFrameRingHeader*>(mapping_);
+  }
+
+ private:
+  void* mapping_;
+  std::size_t size_;
+};
+
+// Forks a consumer that pins the latest slot like SharedMemoryIngest does and
+// kills it while the slot is pinned.
+void KillPinnedConsumer(const std::string& name) {
+  int pipe_file_descriptors[2];
+  REQUIRE(pipe(pipe_file_descriptors) == 0);
+
+  const pid_t consumer = fork();
+  REQUIRE(consumer >= 0);
+  if (consumer == 0) {
+    SharedMemoryMapping mapping(name);
+    auto header = mapping.header();
+    const std::uint32_t latest_slot = header->latest_slot.load();
+    webstreamer::GetSharedFrameSlots(header)[latest_slot]
+        .reference_count.fetch_add(1);
+    const char pinned = 1;
+    if (write(pipe_file_descriptors[1], &pinned, 1) != 1) {
+      _exit(1);
+    }
+    while (true) {
+      pause();
+    }
+  }
+
+  char pinned = 0;
+  REQUIRE(read(pipe_file_descriptors[0], &pinned, 1) == 1);
+  close(pipe_file_descriptors[0]);
+  close(pipe_file_descriptors[1]);
+  REQUIRE(kill(consumer, SIGKILL) == 0);
+  int status = 0;
+  REQUIRE(waitpid(consumer, &status, 0) == consumer);
+  REQUIRE(WIFSIGNALED(status));
+}
+
+}  // namespace
+
+TEST_CASE("SharedMemoryProducer drops frames if no slot is free",
+          "[shared_memory]") {
+  const std::string name = "webstreamer-test-" + std::to_string(getpid());
+  webstreamer::SharedMemoryProducer producer(name, WIDTH, HEIGHT, 3);
+  const std::vector<std::uint8_t> frame(WIDTH * HEIGHT * 3);
+
+  // Two consumers die while each of them pins a different slot, the third
+  // slot holds the latest frame.
+  REQUIRE(producer.PushFrame(WIDTH, HEIGHT, frame.data(), frame.size()));
+  KillPinnedConsumer(name);
+  REQUIRE(producer.PushFrame(WIDTH, HEIGHT, frame.data(), frame.size()));
+  KillPinnedConsumer(name);
+  REQUIRE(producer.PushFrame(WIDTH, HEIGHT, frame.data(), frame.size()));
+
+  CHECK(producer.AcquireWriteFrame(WIDTH, HEIGHT) == nullptr);
+  CHECK_FALSE(producer.PushFrame(WIDTH, HEIGHT, frame.data(), frame.size()));
+
+  // The next consumer releases the pins when it attaches
+  SharedMemoryMapping mapping(name);
+  webstreamer::ReleaseSharedFrameRingPins(mapping.header());
+  REQUIRE(producer.AcquireWriteFrame(WIDTH, HEIGHT) != nullptr);
+  producer.CommitFrame();
+  CHECK(producer.PushFrame(WIDTH, HEIGHT, frame.data(), frame.size()));
+}
+
+TEST_CASE("SharedMemoryProducer rejects truncated frames", "[shared_memory]") {
+  const std::string name = "webstreamer-test-" + std::to_string(getpid());
+  webstreamer::SharedMemoryProducer producer(name, WIDTH, HEIGHT);
+  const std::vector<std::uint8_t> frame(WIDTH * HEIGHT * 3);
+
+  CHECK_FALSE(
+      producer.PushFrame(WIDTH, HEIGHT, frame.data(), frame.size() - 1));
+  CHECK(producer.PushFrame(WIDTH, HEIGHT, frame.data(), frame.size()));
+  CHECK_FALSE(producer.PushFrame(WIDTH + 1, HEIGHT, frame.data(),
+                                 frame.size()));
+}